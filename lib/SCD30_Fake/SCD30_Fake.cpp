@@ -7,6 +7,7 @@ This can be used to seed "random" data for the gadget to perform dry-runs withou
 Activate this library wiith the "FAKE_SENSOR" setting.
 
 */
+#define FS_NO_GLOBALS
 #include "SCD30_Fake.h"
 
 SCD30_Fake::SCD30_Fake(void)
@@ -87,6 +88,12 @@ bool SCD30_Fake::setTemperatureOffset(float tempOffset)
   return true;
 }
 
+// Set the forced recalibration reference (ppm). See 1.3.7.
+bool SCD30_Fake::setForcedRecalibrationFactor(uint16_t concentration)
+{
+  return true;
+}
+
 // Get the altitude compenstation. See 1.3.9.
 uint16_t SCD30_Fake::getAltitudeCompensation(void)
 {
@@ -159,6 +166,19 @@ unsigned long timeRun2 = 0;
 unsigned long counter2 = 2500; // we make our fake sensor a little slower
 bool SCD30_Fake::dataAvailable()
 {
+  if (_tracePath) {
+    if (!_traceOpen) {
+      if (!_trace.open(SPIFFS, _tracePath) || !_trace.next(_next)) {
+        Serial.printf("Can't replay trace %s, making data up instead\n", _tracePath);
+        _tracePath = nullptr;
+        return false;
+      }
+      _traceOpen = true;
+      _startMs = millis();
+      _nextMs = _next.dt;
+    }
+    return (uint64_t)(millis() - _startMs) * _speedup >= _nextMs;
+  }
   if (millis() - timeRun2 >= counter2) {
     timeRun2 += counter2;
     // it's been time!
@@ -182,6 +202,10 @@ bool SCD30_Fake::readMeasurement()
   //   return (false);
   // }
     
+  if (_traceOpen) {
+    return readTrace();
+  }
+
   // make up data!!
   co2 = random(lastCo2F-50,lastCo2F+50);
   temperature = (float)random(lastTempF-1,lastTempF+1)+(float)random(1,99)/100.0;
@@ -195,6 +219,41 @@ bool SCD30_Fake::readMeasurement()
   return (true); // Success! New data available in globals.
 }
 
+void SCD30_Fake::replay(const char *path, uint16_t speedup)
+{
+  _tracePath = path;
+  _speedup = speedup > 0 ? speedup : 1;
+  _traceOpen = false;
+}
+
+// Take every reading that's due, like the real sensor overwriting ones nobody
+// fetched, and report the last
+bool SCD30_Fake::readTrace()
+{
+  uint64_t now = (uint64_t)(millis() - _startMs) * _speedup;
+  do {
+    co2 = _next.co2;
+    temperature = _next.temp / 100.0;
+    humidity = _next.humidity / 100.0;
+    if (!_trace.next(_next)) {
+      Serial.println("End of trace, starting over");
+      _trace.rewind();
+      if (!_trace.next(_next)) { // it was readable the first time round
+        _tracePath = nullptr;
+        _traceOpen = false;
+        break;
+      }
+    }
+    _nextMs += _next.dt; // the first reading's is 0, so it follows straight on
+  } while (_nextMs <= now);
+
+  co2HasBeenReported = false;
+  humidityHasBeenReported = false;
+  temperatureHasBeenReported = false;
+
+  return (true);
+}
+
 // Gets a setting by reading the appropriate register.
 // Returns true if the CRC is valid.
 bool SCD30_Fake::getSettingValue(uint16_t registerAddress, uint16_t *val)
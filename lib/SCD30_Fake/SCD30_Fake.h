@@ -6,9 +6,14 @@ This can be used to seed "random" data for the gadget to perform dry-runs withou
 
 Activate this library wiith the "FAKE_SENSOR" setting.
 
+Given a trace (see SCD30_Trace.h) it plays that back instead, at the pace it
+was recorded or some multiple of it, so the same readings come out on every
+run.
+
 */
 #include "Arduino.h"
 #include <Wire.h>
+#include "SCD30_Trace.h"
 
 class SCD30_Fake
 {
@@ -64,6 +69,12 @@ public:
 
 	uint8_t computeCRC8(uint8_t data[], uint8_t len);
 
+	// Play the trace at path (on SPIFFS) instead of making data up, speedup times faster
+	// than it was recorded. It starts over at the end. Can be called before SPIFFS.begin().
+	void replay(const char *path, uint16_t speedup = 1);
+	bool replaying() const { return _tracePath != nullptr; }
+	uint16_t speedup() const { return _speedup; }
+
 private:
     // Global main datums
     float co2 = 0;
@@ -75,4 +86,14 @@ private:
     bool co2HasBeenReported = true;
     bool humidityHasBeenReported = true;
     bool temperatureHasBeenReported = true;
+
+    bool readTrace();
+
+    const char *_tracePath = nullptr;
+    uint16_t _speedup = 1;
+    bool _traceOpen = false;
+    TraceReader _trace;
+    TraceSample _next;        // the reading that comes out when its time is up
+    uint64_t _nextMs = 0;     // ...which is this far into the trace
+    uint32_t _startMs = 0;    // millis() at the start of the trace
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#define FS_NO_GLOBALS
+#include "SCD30_Trace.h"
+
+bool TraceWriter::begin(fs::FS &fs, const char *path, uint32_t maxBytes) {
+  _fs = &fs;
+  _path = path;
+  _maxBytes = maxBytes;
+  _started = false;
+  fs::File f = fs.open(path, "a");
+  if (!f) {
+    return false;
+  }
+  _size = f.size();
+  if (_size == 0) {
+    _size = f.write((const uint8_t *)TRACE_MAGIC, 4);
+  }
+  f.close();
+  _full = _size >= _maxBytes;
+  return _size >= 4;
+}
+
+void TraceWriter::append(uint32_t ms, uint16_t co2, int16_t temp, uint16_t humidity) {
+  if (!_fs || _full) {
+    return;
+  }
+  // whole tenths of a second, and the clock moves on by exactly that so rounding doesn't add up
+  uint32_t tenths = _started ? (ms - _lastMs + 50) / 100 : 0;
+  int32_t dCo2 = (int32_t)co2 - _last.co2;
+  int32_t dTemp = (int32_t)temp - _last.temp;
+  int32_t dHumidity = (int32_t)humidity - _last.humidity;
+  bool key = !_started || tenths >= TRACE_KEY ||
+             dCo2 < -128 || dCo2 > 127 || dTemp < -128 || dTemp > 127 || dHumidity < -128 || dHumidity > 127;
+  uint8_t len = key ? TRACE_KEY_BYTES : 4;
+
+  if (size() + len > _maxBytes) {
+    flush();
+    _full = true;
+    Serial.println("Trace file is full, recording stopped");
+    return;
+  }
+  if (_pending + len > TRACE_BATCH) {
+    flush();
+  }
+
+  uint8_t *p = _batch + _pending;
+  if (key) {
+    *p++ = TRACE_KEY;
+    memcpy(p, &tenths, 4);
+    memcpy(p + 4, &co2, 2);
+    memcpy(p + 6, &temp, 2);
+    memcpy(p + 8, &humidity, 2);
+  } else {
+    p[0] = tenths;
+    p[1] = (int8_t)dCo2;
+    p[2] = (int8_t)dTemp;
+    p[3] = (int8_t)dHumidity;
+  }
+  _pending += len;
+
+  _lastMs = _started ? _lastMs + tenths * 100 : ms;
+  _started = true;
+  _last.co2 = co2;
+  _last.temp = temp;
+  _last.humidity = humidity;
+}
+
+void TraceWriter::flush() {
+  if (_pending == 0) {
+    return;
+  }
+  fs::File f = _fs->open(_path, "a");
+  size_t written = f ? f.write(_batch, _pending) : 0;
+  f.close();
+  if (written != _pending) { // filesystem full or failing; stop rather than leave a torn record every batch
+    Serial.println("Trace write failed!");
+    writeErrors++;
+    _full = true;
+  }
+  _size += written;
+  _pending = 0;
+}
+
+bool TraceWriter::clear() {
+  if (!_fs) {
+    return false;
+  }
+  _pending = 0;
+  _started = false;
+  _fs->remove(_path);
+  _size = 0;
+  return begin(*_fs, _path, _maxBytes);
+}
+
+bool TraceReader::open(fs::FS &fs, const char *path) {
+  _file = fs.open(path, "r");
+  char magic[4];
+  if (!_file || _file.read((uint8_t *)magic, 4) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0) {
+    _file.close();
+    return false;
+  }
+  rewind();
+  return true;
+}
+
+void TraceReader::rewind() {
+  _file.seek(4);
+  _len = 0;
+  _pos = 0;
+  memset(&_last, 0, sizeof(_last));
+}
+
+// Make sure at least need bytes are read ahead
+bool TraceReader::fill(uint8_t need) {
+  if (_len - _pos >= need) {
+    return true;
+  }
+  memmove(_buf, _buf + _pos, _len - _pos);
+  _len -= _pos;
+  _pos = 0;
+  _len += _file.read(_buf + _len, sizeof(_buf) - _len);
+  return _len >= need;
+}
+
+bool TraceReader::next(TraceSample &out) {
+  if (!_file || !fill(1)) {
+    return false;
+  }
+  const uint8_t *p = _buf + _pos;
+  uint32_t tenths;
+  if (p[0] == TRACE_KEY) {
+    if (!fill(TRACE_KEY_BYTES)) {
+      return false;
+    }
+    p = _buf + _pos;
+    memcpy(&tenths, p + 1, 4);
+    memcpy(&_last.co2, p + 5, 2);
+    memcpy(&_last.temp, p + 7, 2);
+    memcpy(&_last.humidity, p + 9, 2);
+    _pos += TRACE_KEY_BYTES;
+  } else {
+    if (!fill(4)) {
+      return false;
+    }
+    p = _buf + _pos;
+    tenths = p[0];
+    _last.co2 += (int8_t)p[1];
+    _last.temp += (int8_t)p[2];
+    _last.humidity += (int8_t)p[3];
+    _pos += 4;
+  }
+  _last.dt = tenths * 100;
+  out = _last;
+  return true;
+}
@@ -0,0 +1,84 @@
+/*
+
+Sensor traces: real SCD30 readings recorded to a file on the device
+(TraceWriter, the "TRACE_RECORD" setting) and played back by SCD30_Fake
+(TraceReader, the "TRACE_REPLAY" setting or the simulator's --trace).
+
+The file is a 4 byte header ("SCT1") and then one record per reading:
+
+  delta: dt, dCo2, dTemp, dHumidity            4 bytes
+  key:   0xFF, dt (u32), co2, temp, humidity   11 bytes
+
+dt is the time since the reading before, in tenths of a second (a byte
+holds 0-25.4 s, so the SCD30's 2 s interval fits). The deltas are signed
+bytes: ppm, and hundredths of a degree / percent RH. Anything that doesn't
+fit, and the first reading after each boot, is written as a key record
+holding the values themselves. Readings two seconds apart nearly always fit,
+so a day of them comes to about 170 KB.
+
+tools/trace.py turns a trace into CSV and back.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define TRACE_MAGIC "SCT1"
+#define TRACE_KEY 0xFF
+#define TRACE_KEY_BYTES 11
+#define TRACE_BATCH 240 // bytes per flash write, under one 256 byte SPIFFS page
+
+struct TraceSample {
+  uint32_t dt;       // ms since the reading before (to a tenth of a second)
+  uint16_t co2;      // ppm
+  int16_t temp;      // centi-degrees C
+  uint16_t humidity; // centi-percent RH
+};
+
+class TraceWriter {
+public:
+  // Append to path (creating it), until it reaches maxBytes. Call after SPIFFS.begin().
+  bool begin(fs::FS &fs, const char *path, uint32_t maxBytes);
+  // Queue a reading taken at ms (millis()); it reaches flash when the batch fills up
+  void append(uint32_t ms, uint16_t co2, int16_t temp, uint16_t humidity);
+  void flush();
+  // Bytes in the file, including the batch still in RAM
+  uint32_t size() const { return _size + _pending; }
+  // Empty the file and start again
+  bool clear();
+
+  uint32_t writeErrors = 0;
+
+private:
+  fs::FS *_fs = nullptr;
+  const char *_path = nullptr;
+  uint32_t _maxBytes = 0;
+  uint32_t _size = 0; // bytes on flash
+  bool _full = false;
+
+  bool _started = false; // false until the first reading since begin(), which is a key record
+  uint32_t _lastMs = 0;
+  TraceSample _last = {};
+
+  uint8_t _batch[TRACE_BATCH];
+  uint8_t _pending = 0;
+};
+
+class TraceReader {
+public:
+  bool open(fs::FS &fs, const char *path);
+  // The next reading; false at the end of the trace (or a corrupt record)
+  bool next(TraceSample &out);
+  // Back to the first reading
+  void rewind();
+
+private:
+  bool fill(uint8_t need);
+
+  fs::File _file;
+  TraceSample _last = {};
+  uint8_t _buf[64]; // read ahead, so a reading isn't a filesystem call
+  uint8_t _len = 0;
+  uint8_t _pos = 0;
+};
@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+#include <TJpg_Decoder.h>
+#include <Wire.h>
+
+#include <map>
+
+#undef time
+
+namespace sim {
+  uint64_t clockUs = 0;
+  time_t epochAtBoot = 1760000000; // October 2025
+  bool ntpSynced = false;
+  uint32_t ntpSyncAfterMs = 3000;
+  uint32_t wifiAssociateMs = 2000;
+  uint32_t apDownUntilMs = 0;
+  static bool ntpConfigured = false;
+  static unsigned long ntpConfiguredAt = 0;
+
+  void advance(uint32_t ms) {
+    clockUs += (uint64_t)ms * 1000;
+    if (ntpConfigured && !ntpSynced && WiFi.status() == WL_CONNECTED &&
+        millis() - ntpConfiguredAt >= ntpSyncAfterMs) {
+      ntpSynced = true;
+    }
+  }
+
+  time_t now(time_t *t) {
+    // before SNTP has synced the ESP8266 clock counts up from zero at boot
+    time_t v = (ntpSynced ? epochAtBoot : 0) + (time_t)(clockUs / 1000000);
+    if (t) *t = v;
+    return v;
+  }
+}
+
+void configTime(long gmtOffset, int daylightOffset, const char *server1, const char *server2, const char *server3) {
+  sim::ntpConfigured = true;
+  sim::ntpConfiguredAt = millis();
+}
+
+static uint32_t rngState = 0x2545F491;
+static uint32_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+long random(long howbig) { return howbig <= 0 ? 0 : (long)(nextRandom() % (uint32_t)howbig); }
+long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { if (seed) rngState = (uint32_t)seed; }
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  if (enabled) fwrite(buffer, 1, size, stdout);
+  return size;
+}
+
+EspClass ESP;
+
+namespace sim {
+namespace heap {
+  static const uint32_t ARENA = 40000; // what a running badge has left
+  static const uint32_t BLOCK = 8;
+  static std::map<uint32_t, uint32_t> used; // offset -> bytes, in address order
+  static uint32_t usedBytes = 0;
+  uint32_t minFree = ARENA;
+  uint32_t minMaxBlock = ARENA;
+  uint8_t maxFragmentation = 0;
+  uint32_t failures = 0;
+
+  // Walk the holes between the used blocks
+  template <typename F>
+  static void holes(F f) {
+    uint32_t at = 0;
+    for (auto &b : used) {
+      if (b.first > at) f(at, b.first - at);
+      at = b.first + b.second;
+    }
+    if (ARENA > at) f(at, ARENA - at);
+  }
+
+  static uint32_t maxBlock() {
+    uint32_t biggest = 0;
+    holes([&](uint32_t, uint32_t len) { if (len > biggest) biggest = len; });
+    return biggest;
+  }
+
+  // As the core works it out: 100 - 100 * sqrt(sum of the squared hole sizes) / free
+  static uint8_t fragmentation() {
+    double squares = 0;
+    holes([&](uint32_t, uint32_t len) { squares += (double)len * len; });
+    uint32_t free = ARENA - usedBytes;
+    return free ? (uint8_t)(100 - (uint32_t)(sqrt(squares) * 100 / free)) : 0;
+  }
+
+  static void note() {
+    uint32_t free = ARENA - usedBytes;
+    if (free < minFree) minFree = free;
+    uint32_t biggest = maxBlock();
+    if (biggest < minMaxBlock) minMaxBlock = biggest;
+    uint8_t frag = fragmentation();
+    if (frag > maxFragmentation) maxFragmentation = frag;
+  }
+
+  int alloc(size_t size) {
+    uint32_t bytes = (size + 4 + BLOCK - 1) / BLOCK * BLOCK; // with umm's 4 byte header
+    int found = -1;
+    holes([&](uint32_t at, uint32_t len) { if (found < 0 && len >= bytes) found = at; });
+    if (found < 0) {
+      failures++;
+      return -1;
+    }
+    used[found] = bytes;
+    usedBytes += bytes;
+    note();
+    return found;
+  }
+
+  void release(int block) {
+    auto it = used.find(block);
+    if (it == used.end()) return;
+    usedBytes -= it->second;
+    used.erase(it);
+  }
+}
+}
+
+uint32_t EspClass::getFreeHeap() { return sim::heap::ARENA - sim::heap::usedBytes; }
+uint32_t EspClass::getMaxFreeBlockSize() { return sim::heap::maxBlock(); }
+uint8_t EspClass::getHeapFragmentation() { return sim::heap::fragmentation(); }
+uint32_t EspClass::random() { return nextRandom(); }
+
+ESP8266WiFiClass WiFi;
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *pass) {
+  connecting = true;
+  beganAt = millis();
+  return status();
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+  if (!connecting || sim::wifiAssociateMs == 0) return WL_DISCONNECTED;
+  unsigned long from = beganAt > sim::apDownUntilMs ? beganAt : sim::apDownUntilMs;
+  return millis() >= from + sim::wifiAssociateMs ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+MDNSResponder MDNS;
+TwoWire Wire;
+TJpg_Decoder TJpgDec;
@@ -0,0 +1,236 @@
+/*
+
+Host stand-in for the bits of the ESP8266 Arduino core this firmware uses.
+Time is virtual: millis()/micros()/time() only move when delay() (or the
+simulator driver) advances them, so days of uptime can be run in seconds.
+
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(p) (p)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define snprintf_P snprintf
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+// NodeMCU pin names
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+namespace sim {
+  // Virtual clock, in microseconds since "boot"
+  extern uint64_t clockUs;
+  // Wall-clock seconds that virtual boot corresponds to once NTP has "synced"
+  extern time_t epochAtBoot;
+  extern bool ntpSynced;
+  // Virtual time after which configTime() reports a sync
+  extern uint32_t ntpSyncAfterMs;
+  void advance(uint32_t ms);
+  time_t now(time_t *t);
+
+  // The heap as the network stack sees it: a first-fit arena in 8 byte blocks
+  // like umm_malloc's, so ESP.getFreeHeap(), getMaxFreeBlockSize() and
+  // getHeapFragmentation() move (and fragment) as connections come and go.
+  // Only what the simulator allocates here counts; the firmware's own heap use
+  // is part of the fixed baseline.
+  namespace heap {
+    // Offset of the new block, or -1 if no hole is big enough
+    int alloc(size_t size);
+    void release(int block);
+    extern uint32_t minFree;
+    extern uint32_t minMaxBlock;
+    extern uint8_t maxFragmentation;
+    extern uint32_t failures;
+  }
+}
+
+inline unsigned long millis() { return (unsigned long)(sim::clockUs / 1000); }
+inline unsigned long micros() { return (unsigned long)sim::clockUs; }
+inline void delay(unsigned long ms) { sim::advance(ms); }
+inline void delayMicroseconds(unsigned int us) { sim::clockUs += us; }
+inline void yield() {}
+
+// time(NULL) runs off the virtual clock too
+#define time(t) sim::now(t)
+
+void configTime(long gmtOffset, int daylightOffset, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+// newlib on the ESP8266 has these, older glibc does not
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return 0; }
+inline void analogWrite(uint8_t, int) {}
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class String {
+public:
+  String() {}
+  String(const char *s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned int v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  String(float v, unsigned char decimals = 2) { fmt(v, decimals); }
+  String(double v, unsigned char decimals = 2) { fmt(v, decimals); }
+
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  long toInt() const { return atol(s_.c_str()); }
+  float toFloat() const { return atof(s_.c_str()); }
+  bool isEmpty() const { return s_.empty(); }
+  bool startsWith(const String &p) const { return s_.rfind(p.s_, 0) == 0; }
+  bool endsWith(const String &p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  int indexOf(char c) const { auto p = s_.find(c); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(char c) const { auto p = s_.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < s_.size() ? String(s_.substr(from, to - from)) : String();
+  }
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char *o) { s_ += o; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  bool concat(const char *o) { s_ += o; return true; }
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  bool operator==(const char *o) const { return s_ == o; }
+  bool operator!=(const String &o) const { return s_ != o.s_; }
+  bool equals(const String &o) const { return s_ == o.s_; }
+  char operator[](unsigned int i) const { return s_[i]; }
+  friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String &a, const char *b) { return String(a.s_ + b); }
+
+private:
+  void fmt(double v, unsigned char decimals) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s_ = buf;
+  }
+  std::string s_;
+};
+
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t write(const char *s, size_t len) { return write((const uint8_t *)s, len); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(const Printable &x) { return x.printTo(*this); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned int v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(double v, int decimals = 2) { return printf("%.*f", decimals, v); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + print("\r\n"); }
+  size_t println(double v, int decimals) { size_t n = print(v, decimals); return n + print("\r\n"); }
+  size_t println() { return print("\r\n"); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t *)buf, std::min((size_t)len, sizeof(buf) - 1));
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  // Set to false to keep the simulator quiet
+  bool enabled = true;
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize();
+  uint8_t getHeapFragmentation();
+  uint32_t getChipId() { return 0x00C02C02; }
+  uint32_t getCycleCount() { return (uint32_t)(sim::clockUs * 80); }
+  uint32_t random();
+  void restart() { exit(0); }
+};
+extern EspClass ESP;
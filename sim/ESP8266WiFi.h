@@ -0,0 +1,50 @@
+// Host stand-in for the ESP8266 Wi-Fi station: associates after a configurable delay
+#pragma once
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+class IPAddress : public Printable {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(buf);
+  }
+  size_t printTo(Print &p) const override { return p.print(toString()); }
+  uint8_t octets[4];
+};
+
+namespace sim {
+  // Virtual milliseconds an association takes; 0 means the AP is "down"
+  extern uint32_t wifiAssociateMs;
+  // The AP is down until this virtual time (--ap-down)
+  extern uint32_t apDownUntilMs;
+}
+
+class ESP8266WiFiClass {
+public:
+  wl_status_t begin(const char *ssid, const char *pass = nullptr);
+  wl_status_t status();
+  bool disconnect(bool wifioff = false) { connecting = false; return true; }
+  bool mode(WiFiMode_t m) { return true; }
+  bool setAutoReconnect(bool) { return true; }
+  void persistent(bool) {}
+  bool isConnected() { return status() == WL_CONNECTED; }
+  IPAddress localIP() { return status() == WL_CONNECTED ? IPAddress(192, 168, 4, 2) : IPAddress(); }
+  int32_t RSSI() { return -60; }
+
+private:
+  bool connecting = false;
+  unsigned long beganAt = 0;
+};
+extern ESP8266WiFiClass WiFi;
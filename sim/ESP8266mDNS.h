@@ -0,0 +1,11 @@
+// Host stand-in for the mDNS responder
+#pragma once
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+  bool begin(const char *hostname) { return true; }
+  bool addService(const char *service, const char *proto, uint16_t port) { return true; }
+  bool update() { return true; }
+};
+extern MDNSResponder MDNS;
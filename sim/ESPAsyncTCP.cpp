@@ -0,0 +1,103 @@
+#include "ESPAsyncTCP.h"
+#include "collector.h"
+
+#include <algorithm>
+#include <vector>
+
+// the same link as load.cpp's
+static const uint32_t MSS = 536;
+static const uint32_t SND_BUF = 2 * MSS;
+static const uint32_t RTT_MS = 10;
+static const int8_t ERR_CONN = -13; // lwIP's "not connected", what a refused SYN comes back as
+
+static std::vector<AsyncClient *> clients;
+
+AsyncClient::AsyncClient() {
+  clients.push_back(this);
+}
+
+AsyncClient::~AsyncClient() {
+  clients.erase(std::find(clients.begin(), clients.end(), this));
+}
+
+bool AsyncClient::connect(const char *host, uint16_t port) {
+  if (state != IDLE) {
+    return false;
+  }
+  state = CONNECTING;
+  dueMs = millis() + RTT_MS;
+  return true;
+}
+
+void AsyncClient::close(bool now) {
+  if (state == CONNECTING || state == CONNECTED) {
+    disconnect();
+  }
+}
+
+void AsyncClient::disconnect() {
+  state = CLOSED;
+  if (disconnectCb) disconnectCb(disconnectArg, this);
+}
+
+size_t AsyncClient::space() const {
+  return state == CONNECTED ? SND_BUF - unacked : 0;
+}
+
+size_t AsyncClient::add(const char *data, size_t size, uint8_t apiflags) {
+  size = std::min(size, space());
+  request.append(data, size);
+  if (unacked == 0) {
+    dueMs = millis() + RTT_MS;
+  }
+  unacked += size;
+  return size;
+}
+
+void AsyncClient::step(uint64_t now) {
+  switch (state) {
+  case CONNECTING:
+    if (now < dueMs) break;
+    if (!sim::collector::up()) {
+      if (errorCb) errorCb(errorArg, this, ERR_CONN);
+      disconnect();
+      break;
+    }
+    state = CONNECTED;
+    lastRxMs = now;
+    if (connectCb) connectCb(connectArg, this);
+    break;
+
+  case CONNECTED:
+    if (unacked && now >= dueMs) {
+      size_t acked = unacked;
+      unacked = 0;
+      reply = sim::collector::handle(request); // empty until the whole request is in
+      dueMs = now + RTT_MS;
+      if (ackCb) ackCb(ackArg, this, acked, RTT_MS);
+    } else if (!reply.empty() && now >= dueMs) {
+      std::string r = std::move(reply);
+      reply.clear();
+      lastRxMs = now;
+      if (dataCb) dataCb(dataArg, this, (void *)r.data(), r.size());
+      disconnect(); // Connection: close
+    } else if (rxTimeoutMs && now - lastRxMs >= rxTimeoutMs) {
+      if (timeoutCb) timeoutCb(timeoutArg, this, (uint32_t)(now - lastRxMs));
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void AsyncClient::tick() {
+  uint64_t now = millis();
+  // a callback may delete a client (or make one), so walk a copy
+  std::vector<AsyncClient *> all = clients;
+  for (AsyncClient *c : all) {
+    if (std::find(clients.begin(), clients.end(), c) != clients.end()) {
+      c->step(now);
+    }
+  }
+}
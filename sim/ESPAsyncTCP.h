@@ -0,0 +1,58 @@
+// Host stand-in for ESPAsyncTCP. The web server stand-in does not need real sockets; AsyncClient
+// (what the uplink sends with) connects to the stand-in collector in collector.h, over a link
+// with a fixed round trip, on the virtual clock
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <string>
+
+class AsyncClient;
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void *, AsyncClient *, int8_t error)> AcErrorHandler;
+typedef std::function<void(void *, AsyncClient *, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, uint32_t time)> AcTimeoutHandler;
+
+class AsyncClient {
+public:
+  AsyncClient();
+  ~AsyncClient();
+
+  bool connect(const char *host, uint16_t port);
+  void close(bool now = false);
+  bool connected() const { return state == CONNECTED; }
+  size_t space() const;
+  size_t add(const char *data, size_t size, uint8_t apiflags = 0);
+  bool send() { return true; }
+  void setRxTimeout(uint32_t seconds) { rxTimeoutMs = seconds * 1000; }
+
+  void onConnect(AcConnectHandler cb, void *arg = nullptr) { connectCb = cb; connectArg = arg; }
+  void onDisconnect(AcConnectHandler cb, void *arg = nullptr) { disconnectCb = cb; disconnectArg = arg; }
+  void onAck(AcAckHandler cb, void *arg = nullptr) { ackCb = cb; ackArg = arg; }
+  void onError(AcErrorHandler cb, void *arg = nullptr) { errorCb = cb; errorArg = arg; }
+  void onData(AcDataHandler cb, void *arg = nullptr) { dataCb = cb; dataArg = arg; }
+  void onTimeout(AcTimeoutHandler cb, void *arg = nullptr) { timeoutCb = cb; timeoutArg = arg; }
+
+  // Run whatever is due on the virtual clock, for every client; call between loop()s
+  static void tick();
+
+private:
+  enum State { IDLE, CONNECTING, CONNECTED, CLOSED };
+  void step(uint64_t now);
+  void disconnect();
+
+  State state = IDLE;
+  uint64_t dueMs = 0;      // when the connection completes, or the next ack or reply arrives
+  size_t unacked = 0;
+  std::string request;     // what the collector has been sent
+  std::string reply;       // its answer, once the request is complete
+  uint64_t lastRxMs = 0;
+  uint32_t rxTimeoutMs = 0;
+
+  AcConnectHandler connectCb, disconnectCb;
+  AcAckHandler ackCb;
+  AcErrorHandler errorCb;
+  AcDataHandler dataCb;
+  AcTimeoutHandler timeoutCb;
+  void *connectArg = nullptr, *disconnectArg = nullptr, *ackArg = nullptr, *errorArg = nullptr, *dataArg = nullptr, *timeoutArg = nullptr;
+};
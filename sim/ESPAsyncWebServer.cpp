@@ -0,0 +1,387 @@
+#include "ESPAsyncWebServer.h"
+
+static String urlDecode(const std::string &in) {
+  std::string out;
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size()) {
+      out += (char)strtol(in.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return String(out);
+}
+
+static void parseQuery(AsyncWebServerRequest *request, const std::string &query, bool post) {
+  size_t pos = 0;
+  while (pos < query.size()) {
+    size_t amp = query.find('&', pos);
+    if (amp == std::string::npos) amp = query.size();
+    std::string pair = query.substr(pos, amp - pos);
+    size_t eq = pair.find('=');
+    if (!pair.empty()) {
+      request->_addParam(urlDecode(pair.substr(0, eq)),
+                         eq == std::string::npos ? String() : urlDecode(pair.substr(eq + 1)), post);
+    }
+    pos = amp + 1;
+  }
+}
+
+static String contentTypeFor(const String &path) {
+  if (path.endsWith(".html") || path.endsWith(".htm")) return "text/html";
+  if (path.endsWith(".css")) return "text/css";
+  if (path.endsWith(".js")) return "application/javascript";
+  if (path.endsWith(".png")) return "image/png";
+  if (path.endsWith(".jpg")) return "image/jpeg";
+  if (path.endsWith(".json")) return "application/json";
+  return "text/plain";
+}
+
+//------------------------------------------------------------------------------------
+// Responses
+
+AsyncBasicResponse::AsyncBasicResponse(int code, const String &contentType, const String &content)
+  : _content(content) {
+  _code = code;
+  _contentType = contentType;
+  _contentLength = content.length();
+}
+
+size_t AsyncBasicResponse::fillBody(uint8_t *buf, size_t maxLen) {
+  size_t len = std::min(maxLen, _content.length() - _sent);
+  memcpy(buf, _content.c_str() + _sent, len);
+  return len;
+}
+
+AsyncProgmemResponse::AsyncProgmemResponse(int code, const String &contentType, const uint8_t *content, size_t len)
+  : _content(content) {
+  _code = code;
+  _contentType = contentType;
+  _contentLength = len;
+}
+
+size_t AsyncProgmemResponse::fillBody(uint8_t *buf, size_t maxLen) {
+  size_t len = std::min(maxLen, _contentLength - _sent);
+  memcpy_P(buf, _content + _sent, len);
+  return len;
+}
+
+AsyncChunkedResponse::AsyncChunkedResponse(const String &contentType, AwsResponseFiller callback)
+  : _filler(callback) {
+  _contentType = contentType;
+}
+
+size_t AsyncChunkedResponse::fillBody(uint8_t *buf, size_t maxLen) {
+  if (_finished) return 0;
+  // the device reserves room for the "<hex>\r\n ... \r\n" framing
+  size_t len = _filler(buf, maxLen - 8, _sent);
+  if (len == 0) _finished = true;
+  return len;
+}
+
+AsyncResponseStream::AsyncResponseStream(const String &contentType, size_t bufferSize) {
+  _contentType = contentType;
+}
+
+size_t AsyncResponseStream::fillBody(uint8_t *buf, size_t maxLen) {
+  size_t len = std::min(maxLen, _buf.size() - _sent);
+  memcpy(buf, _buf.data() + _sent, len);
+  return len;
+}
+
+AsyncFileResponse::AsyncFileResponse(fs::File file, const String &contentType) : _file(file) {
+  _contentType = contentType;
+  _contentLength = file.size();
+}
+
+size_t AsyncFileResponse::fillBody(uint8_t *buf, size_t maxLen) {
+  return _file.read(buf, maxLen);
+}
+
+//------------------------------------------------------------------------------------
+// Requests
+
+AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer *server, WebRequestMethod method, const String &url)
+  : _server(server), _method(method), _host("co2meter.local") {
+  std::string full(url.c_str());
+  size_t q = full.find('?');
+  _url = String(full.substr(0, q));
+  if (q != std::string::npos) parseQuery(this, full.substr(q + 1), false);
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+  if (_onDisconnect) _onDisconnect();
+  delete _response;
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const {
+  return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file) const {
+  for (auto &p : _params) {
+    if (p->name() == name && p->isPost() == post) return p.get();
+  }
+  return nullptr;
+}
+
+const String &AsyncWebServerRequest::arg(const String &name) const {
+  static const String empty;
+  for (auto &p : _params) {
+    if (p->name() == name) return p->value();
+  }
+  return empty;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String &name) const { return getHeader(name) != nullptr; }
+
+AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name) const {
+  for (auto &h : _headers) {
+    if (strcasecmp(h->name().c_str(), name.c_str()) == 0) return h.get();
+  }
+  return nullptr;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response) {
+  // like the device, only the first response for a request is used
+  if (_response) {
+    delete response;
+    return;
+  }
+  _response = response;
+}
+
+void AsyncWebServerRequest::redirect(const String &url) {
+  AsyncWebServerResponse *response = beginResponse(302);
+  response->addHeader("Location", url);
+  send(response);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(fs::FS &fs, const String &path,
+                                                             const String &contentType, bool download) {
+  fs::File f = fs.open(path, "r");
+  if (!f) return beginResponse(404);
+  return new AsyncFileResponse(f, contentType.length() ? contentType : contentTypeFor(path));
+}
+
+//------------------------------------------------------------------------------------
+// Handlers
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request) {
+  if (!(_method & request->method())) return false;
+  return request->url() == _uri || request->url().startsWith(_uri + "/");
+}
+
+bool AsyncStaticWebHandler::resolve(const String &url, String &path, bool &gzipped) {
+  if (!url.startsWith(_uri)) return false;
+  path = _path + url.substring(_uri.length());
+  if (path.endsWith("/")) path += _defaultFile;
+  if (_fs.exists(path + ".gz")) {
+    path += ".gz";
+    gzipped = true;
+    return true;
+  }
+  gzipped = false;
+  return _fs.exists(path);
+}
+
+bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request) {
+  String path;
+  bool gzipped;
+  return request->method() == HTTP_GET && resolve(request->url(), path, gzipped);
+}
+
+void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request) {
+  String path;
+  bool gzipped = false;
+  resolve(request->url(), path, gzipped);
+  String plain = gzipped ? path.substring(0, path.length() - 3) : path;
+  // like the real handler, the ETag is just the file size
+  fs::File file = _fs.open(path, "r");
+  String etag = String((unsigned long)file.size());
+  file.close();
+  if (_cacheControl.length() && request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("Cache-Control", _cacheControl);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    return;
+  }
+  AsyncWebServerResponse *response = request->beginResponse(_fs, path, contentTypeFor(plain));
+  if (gzipped) response->addHeader("Content-Encoding", "gzip");
+  if (_cacheControl.length()) {
+    response->addHeader("Cache-Control", _cacheControl);
+    response->addHeader("ETag", etag);
+  }
+  request->send(response);
+}
+
+static std::string eventMessage(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  std::string msg;
+  if (reconnect) msg += "retry: " + std::to_string(reconnect) + "\r\n";
+  if (id) msg += "id: " + std::to_string(id) + "\r\n";
+  if (event) msg += std::string("event: ") + event + "\r\n";
+  msg += std::string("data: ") + message + "\r\n\r\n";
+  return msg;
+}
+
+void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  std::string msg = eventMessage(message, event, id, reconnect);
+  received += msg;
+  if (id) _lastId = id;
+  if (_bytesQueued) *_bytesQueued += msg.size();
+}
+
+void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  std::string msg = eventMessage(message, event, id, reconnect);
+  for (auto &c : _clients) {
+    c->received += msg;
+    if (id) c->_lastId = id;
+    _bytesQueued += msg.size();
+  }
+}
+
+AsyncEventSourceClient *AsyncEventSource::_subscribe(uint32_t lastId) {
+  _clients.emplace_back(new AsyncEventSourceClient());
+  _clients.back()->_lastId = lastId;
+  _clients.back()->_bytesQueued = &_bytesQueued;
+  if (_connectcb) _connectcb(_clients.back().get());
+  return _clients.back().get();
+}
+
+void AsyncEventSource::_unsubscribe(AsyncEventSourceClient *client) {
+  _clients.erase(std::remove_if(_clients.begin(), _clients.end(),
+                                [&](const std::unique_ptr<AsyncEventSourceClient> &c) { return c.get() == client; }),
+                 _clients.end());
+}
+
+//------------------------------------------------------------------------------------
+// Server
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest) {
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest);
+  addHandler(handler);
+  sim::http::server = this;
+  return *handler;
+}
+
+AsyncStaticWebHandler &AsyncWebServer::serveStatic(const char *uri, fs::FS &fs, const char *path,
+                                                   const char *cache_control) {
+  AsyncStaticWebHandler *handler = new AsyncStaticWebHandler(uri, fs, path, cache_control);
+  addHandler(handler);
+  sim::http::server = this;
+  return *handler;
+}
+
+void AsyncWebServer::_dispatch(AsyncWebServerRequest *request) {
+  for (AsyncWebHandler *h : _handlers) {
+    if (h->canHandle(request)) {
+      h->handleRequest(request);
+      return;
+    }
+  }
+  if (_notFound) {
+    _notFound(request);
+  } else {
+    request->send(404);
+  }
+}
+
+AsyncEventSource *AsyncWebServer::_eventSource(const String &url) {
+  for (AsyncWebHandler *h : _handlers) {
+    AsyncEventSource *es = dynamic_cast<AsyncEventSource *>(h);
+    if (es && url == es->url()) return es;
+  }
+  return nullptr;
+}
+
+namespace sim {
+namespace http {
+
+AsyncWebServer *server = nullptr;
+
+AsyncEventSourceClient *subscribe(const std::string &url, uint32_t lastId) {
+  AsyncEventSource *es = server ? server->_eventSource(url.c_str()) : nullptr;
+  return es ? es->_subscribe(lastId) : nullptr;
+}
+
+void unsubscribe(const std::string &url, AsyncEventSourceClient *client) {
+  AsyncEventSource *es = server ? server->_eventSource(url.c_str()) : nullptr;
+  if (es) es->_unsubscribe(client);
+}
+
+uint64_t eventBytes() {
+  uint64_t total = 0;
+  if (!server) return 0;
+  for (AsyncWebHandler *h : server->_handlers) {
+    AsyncEventSource *es = dynamic_cast<AsyncEventSource *>(h);
+    if (es) total += es->_bytesQueued;
+  }
+  return total;
+}
+
+std::string Exchange::header(const std::string &name) const {
+  for (auto &h : headers) {
+    if (strcasecmp(h.first.c_str(), name.c_str()) == 0) return h.second;
+  }
+  return "";
+}
+
+bool Exchange::pump(size_t window) {
+  if (done) return false;
+  AsyncWebServerResponse *response = request->_response;
+  if (!response) { // handler never answered; the device would time the client out
+    status = 0;
+    done = true;
+    return false;
+  }
+  if (!status) {
+    status = response->_code;
+    if (response->_contentType.length()) headers.emplace_back("Content-Type", response->_contentType.c_str());
+    for (auto &h : response->_headers) headers.emplace_back(h.name().c_str(), h.value().c_str());
+  }
+  std::vector<uint8_t> buf(window);
+  size_t len = response->fillBody(buf.data(), window);
+  if (len == 0) {
+    if (response->chunked()) wireBytes += 5; // "0\r\n\r\n"
+    done = true;
+    return false;
+  }
+  body.append((const char *)buf.data(), len);
+  wireBytes += len + (response->chunked() ? 8 : 0);
+  response->_sent += len;
+  return true;
+}
+
+std::unique_ptr<Exchange> begin(const std::string &method, const std::string &url,
+                                const std::vector<std::pair<std::string, std::string>> &headers) {
+  std::unique_ptr<Exchange> ex(new Exchange());
+  std::string path = url, form;
+  WebRequestMethod m = method == "POST" ? HTTP_POST : HTTP_GET;
+  if (m == HTTP_POST) { // form fields travel as the query string in the simulator
+    size_t q = url.find('?');
+    if (q != std::string::npos) {
+      path = url.substr(0, q);
+      form = url.substr(q + 1);
+    }
+  }
+  ex->request.reset(new AsyncWebServerRequest(server, m, String(path)));
+  if (!form.empty()) parseQuery(ex->request.get(), form, true);
+  for (auto &h : headers) ex->request->_addHeader(String(h.first), String(h.second));
+  if (server) server->_dispatch(ex->request.get());
+  return ex;
+}
+
+std::unique_ptr<Exchange> request(const std::string &method, const std::string &url,
+                                  const std::vector<std::pair<std::string, std::string>> &headers) {
+  std::unique_ptr<Exchange> ex = begin(method, url, headers);
+  while (ex->pump()) {}
+  return ex;
+}
+
+} // namespace http
+} // namespace sim
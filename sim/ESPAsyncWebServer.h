@@ -0,0 +1,326 @@
+/*
+
+Host stand-in for ESPAsyncWebServer: a loopback dispatcher.
+
+Handlers are registered exactly as on the device. The simulator feeds
+requests in through sim::http and drains responses a TCP window at a time,
+calling chunk fillers with the same (buffer, maxLen, index) contract.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void()> ArDisconnectHandler;
+
+class AsyncWebParameter {
+public:
+  AsyncWebParameter(const String &name, const String &value, bool form = false)
+    : _name(name), _value(value), _isForm(form) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+  bool isPost() const { return _isForm; }
+
+private:
+  String _name, _value;
+  bool _isForm;
+};
+
+class AsyncWebHeader {
+public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+private:
+  String _name, _value;
+};
+
+class AsyncWebServerResponse {
+public:
+  virtual ~AsyncWebServerResponse() {}
+  void setCode(int code) { _code = code; }
+  void setContentLength(size_t len) { _contentLength = len; }
+  void setContentType(const String &type) { _contentType = type; }
+  void addHeader(const String &name, const String &value) { _headers.emplace_back(name, value); }
+
+  // sim: produce up to maxLen body bytes; 0 once the body is complete
+  virtual size_t fillBody(uint8_t *buf, size_t maxLen) = 0;
+  virtual bool chunked() const { return false; }
+
+  int _code = 200;
+  String _contentType;
+  size_t _contentLength = 0;
+  std::vector<AsyncWebHeader> _headers;
+  size_t _sent = 0;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+  AsyncBasicResponse(int code, const String &contentType, const String &content);
+  size_t fillBody(uint8_t *buf, size_t maxLen) override;
+
+private:
+  String _content;
+};
+
+class AsyncProgmemResponse : public AsyncWebServerResponse {
+public:
+  AsyncProgmemResponse(int code, const String &contentType, const uint8_t *content, size_t len);
+  size_t fillBody(uint8_t *buf, size_t maxLen) override;
+
+private:
+  const uint8_t *_content;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse {
+public:
+  AsyncChunkedResponse(const String &contentType, AwsResponseFiller callback);
+  size_t fillBody(uint8_t *buf, size_t maxLen) override;
+  bool chunked() const override { return true; }
+
+private:
+  AwsResponseFiller _filler;
+  bool _finished = false;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+public:
+  AsyncResponseStream(const String &contentType, size_t bufferSize);
+  size_t write(uint8_t c) override { _buf.push_back((char)c); return 1; }
+  size_t write(const uint8_t *data, size_t len) override { _buf.append((const char *)data, len); return len; }
+  using Print::write;
+  size_t fillBody(uint8_t *buf, size_t maxLen) override;
+
+private:
+  std::string _buf;
+};
+
+class AsyncFileResponse : public AsyncWebServerResponse {
+public:
+  AsyncFileResponse(fs::File file, const String &contentType);
+  size_t fillBody(uint8_t *buf, size_t maxLen) override;
+
+private:
+  fs::File _file;
+};
+
+class AsyncWebServerRequest {
+public:
+  AsyncWebServerRequest(AsyncWebServer *server, WebRequestMethod method, const String &url);
+  ~AsyncWebServerRequest();
+
+  WebRequestMethod method() const { return _method; }
+  const String &url() const { return _url; }
+  const String &host() const { return _host; }
+
+  bool hasParam(const String &name, bool post = false, bool file = false) const;
+  AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const;
+  size_t params() const { return _params.size(); }
+  AsyncWebParameter *getParam(size_t num) const { return num < _params.size() ? _params[num].get() : nullptr; }
+  const String &arg(const String &name) const;
+  bool hasArg(const char *name) const { return hasParam(name) || hasParam(name, true); }
+
+  bool hasHeader(const String &name) const;
+  AsyncWebHeader *getHeader(const String &name) const;
+  size_t headers() const { return _headers.size(); }
+
+  void onDisconnect(ArDisconnectHandler fn) { _onDisconnect = fn; }
+
+  void send(AsyncWebServerResponse *response);
+  void send(fs::FS &fs, const String &path, const String &contentType = String(), bool download = false) {
+    send(beginResponse(fs, path, contentType, download));
+  }
+  void send(int code, const String &contentType = String(), const String &content = String()) {
+    send(beginResponse(code, contentType, content));
+  }
+  void send_P(int code, const String &contentType, const uint8_t *content, size_t len) {
+    send(beginResponse_P(code, contentType, content, len));
+  }
+  void send_P(int code, const String &contentType, PGM_P content) {
+    send(beginResponse_P(code, contentType, (const uint8_t *)content, strlen_P(content)));
+  }
+  void redirect(const String &url);
+
+  AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String()) {
+    return new AsyncBasicResponse(code, contentType, content);
+  }
+  AsyncWebServerResponse *beginResponse(fs::FS &fs, const String &path, const String &contentType = String(), bool download = false);
+  AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len) {
+    return new AsyncProgmemResponse(code, contentType, content, len);
+  }
+  AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, PGM_P content) {
+    return beginResponse_P(code, contentType, (const uint8_t *)content, strlen_P(content));
+  }
+  AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback) {
+    return new AsyncChunkedResponse(contentType, callback);
+  }
+  AsyncResponseStream *beginResponseStream(const String &contentType, size_t bufferSize = 1460) {
+    return new AsyncResponseStream(contentType, bufferSize);
+  }
+
+  // sim plumbing
+  void _addParam(const String &name, const String &value, bool post) {
+    _params.emplace_back(new AsyncWebParameter(name, value, post));
+  }
+  void _addHeader(const String &name, const String &value) { _headers.emplace_back(new AsyncWebHeader(name, value)); }
+  AsyncWebServerResponse *_response = nullptr;
+
+private:
+  AsyncWebServer *_server;
+  WebRequestMethod _method;
+  String _url, _host;
+  std::vector<std::unique_ptr<AsyncWebParameter>> _params;
+  std::vector<std::unique_ptr<AsyncWebHeader>> _headers;
+  ArDisconnectHandler _onDisconnect;
+};
+
+class AsyncWebHandler {
+public:
+  virtual ~AsyncWebHandler() {}
+  virtual bool canHandle(AsyncWebServerRequest *request) { return false; }
+  virtual void handleRequest(AsyncWebServerRequest *request) {}
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+  AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn)
+    : _uri(uri), _method(method), _fn(fn) {}
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override { if (_fn) _fn(request); }
+
+private:
+  String _uri;
+  WebRequestMethodComposite _method;
+  ArRequestHandlerFunction _fn;
+};
+
+class AsyncStaticWebHandler : public AsyncWebHandler {
+public:
+  AsyncStaticWebHandler(const char *uri, fs::FS &fs, const char *path, const char *cache_control)
+    : _uri(uri), _fs(fs), _path(path), _cacheControl(cache_control ? cache_control : "") {}
+  AsyncStaticWebHandler &setDefaultFile(const char *filename) { _defaultFile = filename; return *this; }
+  AsyncStaticWebHandler &setCacheControl(const char *cache_control) { _cacheControl = cache_control; return *this; }
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+
+private:
+  bool resolve(const String &url, String &path, bool &gzipped);
+  String _uri;
+  fs::FS &_fs;
+  String _path, _defaultFile = "index.htm", _cacheControl;
+};
+
+class AsyncEventSourceClient {
+public:
+  void send(const char *message, const char *event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+  uint32_t lastId() const { return _lastId; }
+  bool connected() const { return true; }
+
+  // sim: everything "sent" to this subscriber
+  std::string received;
+  uint32_t _lastId = 0;
+  uint64_t *_bytesQueued = nullptr;
+};
+
+typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler {
+public:
+  explicit AsyncEventSource(const String &url) : _url(url) {}
+  const char *url() const { return _url.c_str(); }
+  void onConnect(ArEventHandlerFunction cb) { _connectcb = cb; }
+  void send(const char *message, const char *event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+  size_t count() const { return _clients.size(); }
+  bool canHandle(AsyncWebServerRequest *request) override { return false; }
+
+  // sim plumbing
+  AsyncEventSourceClient *_subscribe(uint32_t lastId = 0);
+  void _unsubscribe(AsyncEventSourceClient *client);
+  uint64_t _bytesQueued = 0;
+
+private:
+  String _url;
+  std::vector<std::unique_ptr<AsyncEventSourceClient>> _clients;
+  ArEventHandlerFunction _connectcb;
+};
+
+class AsyncWebServer {
+public:
+  explicit AsyncWebServer(uint16_t port) : _port(port) {}
+  void begin() { _begun = true; }
+  void end() { _begun = false; }
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler) { _handlers.emplace_back(handler); return *handler; }
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+  AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest) { return on(uri, HTTP_ANY, onRequest); }
+  AsyncStaticWebHandler &serveStatic(const char *uri, fs::FS &fs, const char *path, const char *cache_control = nullptr);
+  void onNotFound(ArRequestHandlerFunction fn) { _notFound = fn; }
+
+  // sim plumbing
+  void _dispatch(AsyncWebServerRequest *request);
+  AsyncEventSource *_eventSource(const String &url);
+  bool _begun = false;
+  std::vector<AsyncWebHandler *> _handlers;
+
+private:
+  uint16_t _port;
+  ArRequestHandlerFunction _notFound;
+};
+
+namespace sim {
+namespace http {
+
+  // One in-flight request/response pair
+  struct Exchange {
+    std::unique_ptr<AsyncWebServerRequest> request;
+    int status = 0;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    size_t wireBytes = 0; // body plus chunked framing
+    bool done = false;
+
+    // Move up to one TCP window of body; returns false once complete
+    bool pump(size_t window = 1460);
+    std::string header(const std::string &name) const;
+  };
+
+  // The server the firmware registered its routes on
+  extern AsyncWebServer *server;
+
+  std::unique_ptr<Exchange> begin(const std::string &method, const std::string &url,
+                                  const std::vector<std::pair<std::string, std::string>> &headers = {});
+  // Run a whole request to completion
+  std::unique_ptr<Exchange> request(const std::string &method, const std::string &url,
+                                    const std::vector<std::pair<std::string, std::string>> &headers = {});
+  // Subscribe to an AsyncEventSource, as if with "Last-Event-ID: lastId"
+  AsyncEventSourceClient *subscribe(const std::string &url, uint32_t lastId = 0);
+  void unsubscribe(const std::string &url, AsyncEventSourceClient *client);
+  // Bytes queued to all event subscribers so far
+  uint64_t eventBytes();
+
+  inline std::unique_ptr<Exchange> get(const std::string &url,
+                                       const std::vector<std::pair<std::string, std::string>> &headers = {}) {
+    return request("GET", url, headers);
+  }
+
+} // namespace http
+} // namespace sim
@@ -0,0 +1,92 @@
+#include "FS.h"
+
+#include <sys/stat.h>
+#include <dirent.h>
+
+namespace sim {
+  std::string fsRoot = "sim_fs";
+}
+
+fs::FS SPIFFS;
+
+static const size_t FS_TOTAL_BYTES = 1024 * 1024;
+
+static std::string hostPath(const char *path) {
+  return sim::fsRoot + (path[0] == '/' ? "" : "/") + path;
+}
+
+static void makeParents(const std::string &path) {
+  for (size_t i = sim::fsRoot.size() + 1; i < path.size(); i++) {
+    if (path[i] == '/') mkdir(path.substr(0, i).c_str(), 0755);
+  }
+}
+
+// Walk the host tree, reporting names relative to the root (with a leading '/')
+static void walk(const std::string &dir, std::vector<std::pair<std::string, size_t>> &out) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) return;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.') continue;
+    std::string full = dir + "/" + e->d_name;
+    struct stat st;
+    if (stat(full.c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      walk(full, out);
+    } else {
+      out.push_back({full.substr(sim::fsRoot.size()), (size_t)st.st_size});
+    }
+  }
+  closedir(d);
+}
+
+namespace fs {
+
+bool FS::begin() {
+  mkdir(sim::fsRoot.c_str(), 0755);
+  return true;
+}
+
+File FS::open(const char *path, const char *mode) {
+  std::string full = hostPath(path);
+  if (mode[0] != 'r') makeParents(full);
+  // "a" on SPIFFS allows reads and seeks within the file too
+  const char *hostMode = mode[0] == 'r' ? (mode[1] == '+' ? "r+b" : "rb") : mode[0] == 'w' ? "w+b" : "a+b";
+  FILE *fp = fopen(full.c_str(), hostMode);
+  return fp ? File(fp, path) : File();
+}
+
+bool FS::exists(const char *path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+  std::string dest = hostPath(to);
+  makeParents(dest);
+  return ::rename(hostPath(from).c_str(), dest.c_str()) == 0;
+}
+
+Dir FS::openDir(const char *path) {
+  std::vector<std::pair<std::string, size_t>> all, matched;
+  walk(sim::fsRoot, all);
+  std::sort(all.begin(), all.end());
+  for (auto &e : all) {
+    if (e.first.rfind(path, 0) == 0) matched.push_back(e);
+  }
+  return Dir(matched);
+}
+
+bool FS::info(FSInfo &info) {
+  std::vector<std::pair<std::string, size_t>> all;
+  walk(sim::fsRoot, all);
+  size_t used = 0;
+  for (auto &e : all) used += (e.second + 255) & ~255;
+  info = {FS_TOTAL_BYTES, used, 8192, 256, 5, 32};
+  return true;
+}
+
+} // namespace fs
@@ -0,0 +1,105 @@
+/*
+
+Host stand-in for the ESP8266 filesystem API, backed by a directory on the
+host (see sim::fsRoot). Like SPIFFS the namespace is flat: "/log/1.bin" is a
+file name containing slashes, and openDir() matches on prefix.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <unistd.h>
+
+namespace sim {
+  extern std::string fsRoot;
+}
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+class File : public Stream {
+public:
+  File() {}
+  File(FILE *fp, const std::string &name) : fp(fp, &fclose), path(name) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t size) override { return fp ? fwrite(buf, 1, size, fp.get()) : 0; }
+  using Print::write;
+  size_t read(uint8_t *buf, size_t size) { return fp ? fread(buf, 1, size, fp.get()) : 0; }
+  int read() override { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+  int available() override { return fp ? (int)(size() - position()) : 0; }
+  bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+    return fp && fseek(fp.get(), pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0;
+  }
+  size_t position() const { return fp ? ftell(fp.get()) : 0; }
+  size_t size() const {
+    if (!fp) return 0;
+    long pos = ftell(fp.get());
+    fseek(fp.get(), 0, SEEK_END);
+    long len = ftell(fp.get());
+    fseek(fp.get(), pos, SEEK_SET);
+    return len;
+  }
+  void flush() { if (fp) fflush(fp.get()); }
+  bool truncate(uint32_t size) { return fp && fflush(fp.get()) == 0 && ftruncate(fileno(fp.get()), size) == 0; }
+  void close() { fp.reset(); }
+  const char *name() const { return path.c_str(); }
+  operator bool() const { return (bool)fp; }
+
+private:
+  std::shared_ptr<FILE> fp;
+  std::string path;
+};
+
+class Dir {
+public:
+  Dir() {}
+  explicit Dir(std::vector<std::pair<std::string, size_t>> entries) : entries(std::move(entries)) {}
+  bool next() { return ++pos < (int)entries.size(); }
+  String fileName() const { return String(entries[pos].first); }
+  size_t fileSize() const { return entries[pos].second; }
+
+private:
+  std::vector<std::pair<std::string, size_t>> entries;
+  int pos = -1;
+};
+
+class FS {
+public:
+  bool begin();
+  void end() {}
+  File open(const char *path, const char *mode);
+  File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  Dir openDir(const char *path);
+  Dir openDir(const String &path) { return openDir(path.c_str()); }
+  bool info(FSInfo &info);
+};
+
+} // namespace fs
+
+extern fs::FS SPIFFS;
+
+#ifndef FS_NO_GLOBALS
+using fs::File;
+using fs::Dir;
+using fs::FSInfo;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+#endif
@@ -0,0 +1,3 @@
+// Host stand-in: the simulated TFT has no bus to configure
+#pragma once
+#include <Arduino.h>
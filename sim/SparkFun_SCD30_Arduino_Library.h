@@ -0,0 +1,24 @@
+// Host stand-in for the SparkFun SCD30 driver, only here so the sketch's
+// include resolves: there is no I2C bus on the host, so the simulator build
+// always reads lib/SCD30_Fake instead.
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+
+class SCD30 {
+public:
+  bool begin(TwoWire &wirePort = Wire, bool autoCalibrate = false, bool measBegin = true) { return true; }
+  bool dataAvailable() { return millis() - last >= 2000 ? (last = millis(), true) : false; }
+  uint16_t getCO2() { return 600; }
+  float getTemperature() { return 21.5f; }
+  float getHumidity() { return 45.0f; }
+  bool setAltitudeCompensation(uint16_t altitude) { return true; }
+  uint16_t getAltitudeCompensation() { return 0; }
+  bool getAutoSelfCalibration() { return false; }
+  uint16_t getMeasurementInterval() { return 2; }
+  float getTemperatureOffset() { return 0; }
+  bool setForcedRecalibrationFactor(uint16_t concentration) { return true; }
+
+private:
+  unsigned long last = 0;
+};
@@ -0,0 +1,144 @@
+#include "TFT_eSPI.h"
+
+namespace sim {
+  TftCounters tft;
+}
+
+// Cost of a CASET/RASET/RAMWR address window on the ILI9163
+static const uint32_t WINDOW_OVERHEAD = 11;
+
+TFT_eSPI::TFT_eSPI(int16_t w, int16_t h) : _width(w), _height(h), _frame(w * h, TFT_BLACK) {}
+
+void TFT_eSPI::account(uint32_t pixels) {
+  sim::tft.pixels += pixels;
+  sim::tft.spiBytes += pixels * 2 + WINDOW_OVERHEAD;
+  sim::tft.transactions++;
+}
+
+void TFT_eSPI::plot(int32_t x, int32_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+  _frame[y * _width + x] = color;
+}
+
+uint16_t TFT_eSPI::readPixel(int32_t x, int32_t y) const {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) return 0;
+  return _frame[y * _width + x];
+}
+
+void TFT_eSPI::setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h) {
+  _winX = x; _winY = y; _winW = w; _winH = h; _winPos = 0;
+  sim::tft.spiBytes += WINDOW_OVERHEAD;
+  sim::tft.transactions++;
+}
+
+void TFT_eSPI::pushPixels(const void *data, uint32_t len) {
+  const uint16_t *p = (const uint16_t *)data;
+  for (uint32_t i = 0; i < len && _winW > 0; i++, _winPos++) {
+    uint16_t c = p[i];
+    if (_swapBytes) c = (c >> 8) | (c << 8);
+    // panel RAM is big-endian, so swapped data lands as the native colour
+    c = (c >> 8) | (c << 8);
+    plot(_winX + _winPos % _winW, _winY + _winPos / _winW, c);
+  }
+  sim::tft.pixels += len;
+  sim::tft.spiBytes += len * 2;
+}
+
+void TFT_eSPI::pushColor(uint16_t color, uint32_t len) {
+  for (uint32_t i = 0; i < len && _winW > 0; i++, _winPos++) {
+    plot(_winX + _winPos % _winW, _winY + _winPos / _winW, color);
+  }
+  sim::tft.pixels += len;
+  sim::tft.spiBytes += len * 2;
+}
+
+void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color) {
+  plot(x, y, color);
+  account(1);
+}
+
+void TFT_eSPI::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color) {
+  int32_t dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+  int32_t dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+  int32_t err = dx + dy;
+  uint32_t n = 0;
+  while (true) {
+    plot(x0, y0, color); n++;
+    if (x0 == x1 && y0 == y1) break;
+    int32_t e2 = 2 * err;
+    if (e2 >= dy) { err += dy; x0 += sx; }
+    if (e2 <= dx) { err += dx; y0 += sy; }
+  }
+  account(n);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+  if (w <= 0 || h <= 0) return;
+  for (int32_t j = y; j < y + h; j++)
+    for (int32_t i = x; i < x + w; i++) plot(i, j, color);
+  account(w * h);
+}
+
+void TFT_eSPI::fillTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t color) {
+  int32_t minX = std::min({x0, x1, x2}), maxX = std::max({x0, x1, x2});
+  int32_t minY = std::min({y0, y1, y2}), maxY = std::max({y0, y1, y2});
+  uint32_t n = 0;
+  for (int32_t y = minY; y <= maxY; y++) {
+    for (int32_t x = minX; x <= maxX; x++) {
+      int32_t d0 = (x1 - x0) * (y - y0) - (y1 - y0) * (x - x0);
+      int32_t d1 = (x2 - x1) * (y - y1) - (y2 - y1) * (x - x1);
+      int32_t d2 = (x0 - x2) * (y - y2) - (y0 - y2) * (x - x2);
+      bool neg = d0 < 0 || d1 < 0 || d2 < 0, pos = d0 > 0 || d1 > 0 || d2 > 0;
+      if (!(neg && pos)) { plot(x, y, color); n++; }
+    }
+  }
+  account(n);
+}
+
+void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data) {
+  for (int32_t j = 0; j < h; j++) {
+    for (int32_t i = 0; i < w; i++) {
+      uint16_t c = data[j * w + i];
+      if (_swapBytes) c = (c >> 8) | (c << 8);
+      c = (c >> 8) | (c << 8);
+      plot(x + i, y + j, c);
+    }
+  }
+  account(w * h);
+}
+
+uint16_t TFT_eSPI::alphaBlend(uint8_t alpha, uint16_t fgc, uint16_t bgc) {
+  uint16_t fgR = ((fgc >> 10) & 0x3E) + 1, fgG = ((fgc >> 4) & 0x7E) + 1, fgB = ((fgc << 1) & 0x3E) + 1;
+  uint16_t bgR = ((bgc >> 10) & 0x3E) + 1, bgG = ((bgc >> 4) & 0x7E) + 1, bgB = ((bgc << 1) & 0x3E) + 1;
+  uint16_t r = (((fgR * alpha) + (bgR * (255 - alpha))) >> 9);
+  uint16_t g = (((fgG * alpha) + (bgG * (255 - alpha))) >> 9);
+  uint16_t b = (((fgB * alpha) + (bgB * (255 - alpha))) >> 9);
+  return (r << 11) | (g << 5) | (b << 0);
+}
+
+void TFT_eSPI::loadFont(const String &fontName, bool flash) {
+  sim::tft.fontLoads++;
+  _fontHeight = fontName.endsWith("36") ? 36 : 16;
+}
+
+int16_t TFT_eSPI::drawString(const String &s, int32_t x, int32_t y) {
+  int16_t w = std::max<int16_t>(textWidth(s), _padding);
+  int32_t left = x;
+  if (_datum == TC_DATUM || _datum == MC_DATUM || _datum == BC_DATUM) left = x - w / 2;
+  else if (_datum == TR_DATUM || _datum == MR_DATUM || _datum == BR_DATUM) left = x - w;
+  fillRect(left, y, w, _fontHeight, _textBg);
+  _cursorX = left + textWidth(s);
+  _cursorY = y;
+  return w;
+}
+
+int16_t TFT_eSPI::drawFloat(float v, uint8_t dp, int32_t x, int32_t y) {
+  return drawString(String(v, dp), x, y);
+}
+
+size_t TFT_eSPI::write(uint8_t c) {
+  if (c == '\n') { _cursorY += _fontHeight; return 1; }
+  fillRect(_cursorX, _cursorY, _fontHeight / 2, _fontHeight, _textBg);
+  _cursorX += _fontHeight / 2;
+  return 1;
+}
@@ -0,0 +1,131 @@
+/*
+
+Host stand-in for TFT_eSPI: an in-memory RGB565 framebuffer plus counters
+for the pixels and bytes that would have crossed the SPI bus.
+
+Smooth fonts are not rasterised; text calls only account for the area they
+would have touched so the counters stay comparable with the real panel.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef TFT_WIDTH
+  #define TFT_WIDTH 130
+#endif
+#ifndef TFT_HEIGHT
+  #define TFT_HEIGHT 129
+#endif
+
+#define TFT_BLACK       0x0000
+#define TFT_NAVY        0x000F
+#define TFT_DARKGREEN   0x03E0
+#define TFT_DARKGREY    0x7BEF
+#define TFT_LIGHTGREY   0xD69A
+#define TFT_BLUE        0x001F
+#define TFT_GREEN       0x07E0
+#define TFT_CYAN        0x07FF
+#define TFT_RED         0xF800
+#define TFT_MAGENTA     0xF81F
+#define TFT_YELLOW      0xFFE0
+#define TFT_WHITE       0xFFFF
+#define TFT_ORANGE      0xFDA0
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+namespace sim {
+  struct TftCounters {
+    uint64_t pixels = 0;      // pixels written to panel RAM
+    uint64_t spiBytes = 0;    // pixel data plus command/address overhead
+    uint64_t transactions = 0;
+    uint64_t fontLoads = 0;   // smooth font (re)loads from the filesystem
+  };
+  extern TftCounters tft;
+}
+
+class TFT_eSPI : public Print {
+public:
+  TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT);
+
+  void init(uint8_t tc = 0) {}
+  void setRotation(uint8_t r) { rotation = r; }
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+  void setSwapBytes(bool swap) { _swapBytes = swap; }
+  bool getSwapBytes() const { return _swapBytes; }
+
+  void writecommand(uint8_t c) { sim::tft.spiBytes += 1; }
+  void startWrite() {}
+  void endWrite() {}
+  void setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h);
+  void pushPixels(const void *data, uint32_t len);
+  void pushColor(uint16_t color, uint32_t len);
+
+  void drawPixel(int32_t x, int32_t y, uint32_t color);
+  void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color);
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) { fillRect(x, y, 1, h, color); }
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) { fillRect(x, y, w, 1, color); }
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  void fillScreen(uint32_t color) { fillRect(0, 0, _width, _height, color); }
+  void fillTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t color);
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data);
+  uint16_t readPixel(int32_t x, int32_t y) const;
+
+  uint16_t alphaBlend(uint8_t alpha, uint16_t fgc, uint16_t bgc);
+  uint16_t color565(uint8_t r, uint8_t g, uint8_t b) {
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+  }
+
+  // Text: metrics are approximate, drawing only fills the padded box
+  void loadFont(const String &fontName, bool flash = true);
+  void loadFont(const uint8_t array[]) { sim::tft.fontLoads++; _fontHeight = 16; }
+  void unloadFont() { _fontHeight = 8; }
+  void setTextColor(uint16_t fg, uint16_t bg) { _textColor = fg; _textBg = bg; }
+  void setTextColor(uint16_t fg) { _textColor = fg; }
+  void setTextDatum(uint8_t d) { _datum = d; }
+  void setTextPadding(uint16_t p) { _padding = p; }
+  void setTextSize(uint8_t s) {}
+  void setTextFont(uint8_t f) { _fontHeight = 8; }
+  void setCursor(int16_t x, int16_t y) { _cursorX = x; _cursorY = y; }
+  int16_t textWidth(const String &s) { return s.length() * _fontHeight / 2; }
+  int16_t fontHeight() { return _fontHeight; }
+  int16_t drawString(const String &s, int32_t x, int32_t y);
+  int16_t drawString(const char *s, int32_t x, int32_t y) { return drawString(String(s), x, y); }
+  int16_t drawFloat(float v, uint8_t dp, int32_t x, int32_t y);
+  int16_t drawNumber(long v, int32_t x, int32_t y) { return drawString(String(v), x, y); }
+  // Built-in 6x8 font (font 1) only: one 48 pixel window with the background set
+  int16_t drawChar(uint16_t c, int32_t x, int32_t y, uint8_t font) {
+    fillRect(x, y, 6, 8, _textBg);
+    return 6;
+  }
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  // Framebuffer, exposed for the simulator's screenshot dump
+  uint16_t *frame() { return _frame.data(); }
+
+protected:
+  void account(uint32_t pixels);
+  void plot(int32_t x, int32_t y, uint16_t color);
+
+  int16_t _width, _height;
+  uint8_t rotation = 0;
+  bool _swapBytes = false;
+  std::vector<uint16_t> _frame;
+  int32_t _winX = 0, _winY = 0, _winW = 0, _winH = 0;
+  uint32_t _winPos = 0;
+  uint16_t _textColor = TFT_WHITE, _textBg = TFT_BLACK;
+  uint8_t _datum = TL_DATUM;
+  uint16_t _padding = 0;
+  int16_t _cursorX = 0, _cursorY = 0;
+  int16_t _fontHeight = 8;
+};
@@ -0,0 +1,21 @@
+// Host stand-in for TJpg_Decoder: icons are not decoded, the area is just accounted for
+#pragma once
+#include <Arduino.h>
+
+typedef bool (*SketchCallback)(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *data);
+
+class TJpg_Decoder {
+public:
+  void setCallback(SketchCallback cb) { callback = cb; }
+  void setJpgScale(uint8_t scale) { this->scale = scale; }
+  uint8_t drawFsJpg(int32_t x, int32_t y, const char *path) {
+    static uint16_t block[16 * 16] = {0};
+    if (callback) callback(x, y, 16, 16, block);
+    return 0;
+  }
+
+private:
+  SketchCallback callback = nullptr;
+  uint8_t scale = 1;
+};
+extern TJpg_Decoder TJpgDec;
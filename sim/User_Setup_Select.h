@@ -0,0 +1,2 @@
+// Host stand-in: panel geometry comes from the build flags
+#pragma once
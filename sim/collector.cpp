@@ -0,0 +1,88 @@
+#include "collector.h"
+#include "samplecodec.h"
+
+#include <map>
+#include <set>
+
+namespace sim {
+namespace collector {
+
+uint32_t downUntilMs = 0;
+
+static uint32_t requests = 0;
+static uint32_t refused = 0;   // malformed frames
+static uint32_t frames = 0;
+static uint32_t samples = 0;
+static uint32_t duplicates = 0;
+static std::map<uint32_t, std::set<uint32_t>> seen; // badge -> sample times
+
+bool up() {
+  return millis() >= downUntilMs;
+}
+
+bool used() {
+  return requests > 0;
+}
+
+static uint32_t get16(const uint8_t *p) {
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return get16(p) | get16(p + 2) << 16;
+}
+
+std::string handle(const std::string &request) {
+  size_t headEnd = request.find("\r\n\r\n");
+  if (headEnd == std::string::npos) {
+    return "";
+  }
+  size_t lengthAt = request.find("Content-Length: ");
+  size_t length = lengthAt < headEnd ? strtoul(request.c_str() + lengthAt + 16, nullptr, 10) : 0;
+  if (request.size() < headEnd + 4 + length) {
+    return ""; // more to come
+  }
+  requests++;
+
+  const uint8_t *frame = (const uint8_t *)request.data() + headEnd + 4;
+  SampleDecoder decoder;
+  if (request.compare(0, 5, "POST ") != 0 || length < 12 || memcmp(frame, "CO2F", 4) != 0 || frame[4] != 2 ||
+      length != 12 + get16(frame + 6) || !decoder.begin(frame + 12, length - 12)) {
+    refused++;
+    return "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+  }
+  std::set<uint32_t> &times = seen[get32(frame + 8)];
+  uint32_t count = 0;
+  Sample s;
+  while (decoder.next(s)) {
+    if (!times.insert(s.time).second) {
+      duplicates++;
+    }
+    count++;
+  }
+  if (count != decoder.count()) {
+    refused++; // cut short: the badge has it wrong
+    return "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+  }
+  frames++;
+  samples += count;
+  return "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+}
+
+void report() {
+  printf("collector: %u requests, %u frames, %u samples (%u already had), %u refused\n", requests, frames, samples,
+         duplicates, refused);
+  for (auto &badge : seen) {
+    uint32_t widest = 0;
+    uint32_t last = 0;
+    for (uint32_t t : badge.second) {
+      if (last && t - last > widest) widest = t - last;
+      last = t;
+    }
+    printf("collector: badge %08x: %zu samples, %u..%u, widest gap %u s\n", badge.first, badge.second.size(),
+           *badge.second.begin(), *badge.second.rbegin(), widest);
+  }
+}
+
+} // namespace collector
+} // namespace sim
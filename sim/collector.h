@@ -0,0 +1,31 @@
+/*
+
+Stand-in collector for the simulator: what AsyncClient connects to, whatever
+host it asks for. It takes POSTs of uplink frames (src/uplink.h), checks them
+and keeps the sample times it has seen per badge, so report() can say how
+many arrived, how many were sent twice and whether any are missing between
+the first and the last. tools/collector.py is the same thing for real badges.
+
+While it is down (--collector-down) connections are refused, like a host
+whose collector process isn't running.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+
+namespace sim {
+namespace collector {
+
+  // Connections are refused until this virtual time
+  extern uint32_t downUntilMs;
+  bool up();
+  // Handle a complete HTTP request; the reply to send back
+  std::string handle(const std::string &request);
+  // true if there's been any traffic to report on
+  bool used();
+  void report();
+
+} // namespace collector
+} // namespace sim
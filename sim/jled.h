@@ -0,0 +1,23 @@
+// Host stand-in for JLed: tracks state only, there is no LED to drive
+#pragma once
+#include <Arduino.h>
+
+class JLed {
+public:
+  explicit JLed(uint8_t pin) {}
+  JLed &Breathe(uint16_t fadeOn, uint16_t on, uint16_t fadeOff) { period = fadeOn + on + fadeOff; return *this; }
+  JLed &Blink(uint16_t on, uint16_t off) { period = on + off; return *this; }
+  JLed &Repeat(uint16_t n) { return *this; }
+  JLed &Forever() { return *this; }
+  JLed &MaxBrightness(uint8_t b) { return *this; }
+  bool IsRunning() const { return running && millis() - started < period; }
+  JLed &Reset() { running = true; started = millis(); return *this; }
+  bool Update() { updates++; return IsRunning(); }
+  JLed &Stop() { running = false; return *this; }
+  uint32_t updates = 0;
+
+private:
+  bool running = false;
+  unsigned long started = 0;
+  uint16_t period = 0;
+};
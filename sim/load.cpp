@@ -0,0 +1,360 @@
+#include "load.h"
+#include <ESPAsyncWebServer.h>
+#include <FS.h>
+
+#include <deque>
+#include <list>
+#include <map>
+
+namespace sim {
+namespace load {
+
+// lwIP's "lower memory" build, the default for the ESP8266 core
+static const uint32_t MSS = 536;
+static const uint32_t SND_BUF = 2 * MSS;
+static const uint32_t RTT_MS = 10;
+static const uint32_t LINK_BYTES_PER_MS = 100; // ~100 KB/s, about what ESPAsyncWebServer gets out of the ESP8266
+static const uint8_t SYN_RETRIES = 4;          // a browser waits 1 + 2 + 4 + 8 s for a connection, then fails the request
+static const uint32_t EVENTS_RETRY_MS = 3000;  // EventSource's reconnect delay
+static const uint8_t BROWSER_CONNECTIONS = 6;  // per host; the browser queues anything more itself
+
+// Heap blocks, in the sizes ESPAsyncWebServer and lwIP ask for
+static const size_t CONNECTION_BLOCKS[] = { 172, 88, 184 }; // tcp_pcb, AsyncClient, AsyncWebServerRequest
+static const size_t REQUEST_HEADERS = 6;                    // the headers a browser sends, kept as Strings
+static const size_t HEADER_BYTES = 40;
+static const size_t RESPONSE_BYTES = 120;                   // the response object and its headers
+static const size_t PBUF_OVERHEAD = 16;
+
+struct Client;
+
+struct Connection {
+  Client *client;
+  std::string route; // what it's reported under
+  std::string url;
+  uint64_t madeMs;   // when the browser made the request
+  std::unique_ptr<http::Exchange> exchange; // null for an /events subscriber
+  AsyncEventSourceClient *events = nullptr;
+  size_t eventsSent = 0;
+
+  std::vector<int> blocks; // held for the connection's life
+  struct Segment {
+    uint64_t ackMs;
+    int block;
+    uint32_t bytes;
+  };
+  std::deque<Segment> inFlight;
+  uint32_t unacked = 0;
+  bool headersSent = false;
+  size_t bytes = 0;
+};
+
+struct Request {
+  Client *client;
+  std::string route, url;
+  uint64_t madeMs, tryMs;
+  uint8_t tries;
+};
+
+struct Client {
+  bool polling;
+  bool visited = false;
+  uint64_t loadMs;
+  uint64_t tableMs = UINT64_MAX;
+  uint64_t co2Ms = UINT64_MAX;
+  uint64_t climateMs = UINT64_MAX;
+  uint64_t eventsMs = UINT64_MAX;
+  Connection *events = nullptr;
+  uint8_t connections = 0; // open to the badge, /events included
+  std::map<std::string, std::string> etags; // the browser's cache: URL -> ETag
+  uint32_t draw = 0;                        // DataTables' request counter
+};
+
+struct RouteStats {
+  std::vector<uint32_t> latencies;
+  uint64_t bytes = 0;
+  uint32_t notModified = 0;
+  uint32_t failed = 0;
+};
+
+static Options options;
+static bool started = false;
+static uint64_t startMs, lastMs;
+static int64_t tokens = 0;
+static std::vector<Client> clients;
+static std::vector<std::string> assets;
+static std::deque<Request> backlog;
+static std::list<std::unique_ptr<Connection>> connections;
+static std::map<std::string, RouteStats> stats;
+static uint32_t eventsRefused = 0, eventsSubscribed = 0, stalls = 0;
+
+void start(const Options &o) {
+  options = o;
+  clients.resize(o.clients);
+  for (uint32_t i = 0; i < o.clients; i++) {
+    clients[i].polling = i < o.polling;
+  }
+}
+
+static void issue(Client &c, const std::string &route, const std::string &url, uint64_t now) {
+  backlog.push_back({ &c, route, url, now, now, 0 });
+}
+
+// Everything a connection holds comes from the heap; false if it didn't fit
+static bool open(Connection &conn) {
+  for (size_t size : CONNECTION_BLOCKS) {
+    conn.blocks.push_back(heap::alloc(size));
+  }
+  for (size_t i = 0; i < REQUEST_HEADERS; i++) {
+    conn.blocks.push_back(heap::alloc(HEADER_BYTES));
+  }
+  return std::find(conn.blocks.begin(), conn.blocks.end(), -1) == conn.blocks.end();
+}
+
+static void close(Connection *conn) {
+  conn->client->connections--;
+  for (int b : conn->blocks) heap::release(b);
+  for (auto &s : conn->inFlight) heap::release(s.block);
+  connections.remove_if([&](const std::unique_ptr<Connection> &c) { return c.get() == conn; });
+}
+
+static void subscribe(Client &c, uint64_t now) {
+  c.eventsMs = UINT64_MAX;
+  std::unique_ptr<Connection> conn(new Connection());
+  if (connections.size() >= options.connections || !open(*conn)) {
+    for (int b : conn->blocks) heap::release(b);
+    eventsRefused++;
+    c.eventsMs = now + EVENTS_RETRY_MS;
+    return;
+  }
+  conn->client = &c;
+  c.connections++;
+  conn->route = "/events";
+  conn->madeMs = now;
+  conn->events = http::subscribe("/events");
+  eventsSubscribed++;
+  c.events = conn.get();
+  connections.push_back(std::move(conn));
+}
+
+// (Re)load the page: whatever the old one had open goes
+// The first page, newest first, as DataTables asks for it (less the per-column parameters the badge ignores)
+static std::string tablePage(Client &c) {
+  return "/table?draw=" + std::to_string(++c.draw) + "&start=0&length=10&order[0][column]=0&order[0][dir]=desc&search[value]=";
+}
+
+static void load(Client &c, uint64_t now) {
+  if (c.events) {
+    http::unsubscribe("/events", c.events->events);
+    close(c.events);
+    c.events = nullptr;
+  }
+  backlog.erase(std::remove_if(backlog.begin(), backlog.end(), [&](const Request &r) { return r.client == &c; }), backlog.end());
+  c.tableMs = c.co2Ms = c.climateMs = c.eventsMs = UINT64_MAX;
+  issue(c, "/", "/", now);
+  c.loadMs = options.reloadMinutes ? now + options.reloadMinutes * 60000ULL : UINT64_MAX;
+}
+
+// What the page does once a response is in
+static void loaded(Client &c, const Connection &conn, uint64_t now) {
+  const http::Exchange &ex = *conn.exchange;
+  if (ex.status == 200 && !ex.header("ETag").empty()) {
+    c.etags[conn.url] = ex.header("ETag");
+  }
+
+  if (conn.route == "/") {
+    if (!c.visited) { // the assets are immutable, so only ever fetched once
+      for (auto &a : assets) issue(c, "/a/*", a, now);
+      c.visited = true;
+    }
+    issue(c, "/table page", tablePage(c), now);
+    c.tableMs = now + 60000;
+    if (c.polling) {
+      issue(c, "/co2", "/co2", now);
+      issue(c, "/temp", "/temp", now);
+      issue(c, "/humidity", "/humidity", now);
+      c.co2Ms = now + 5000;
+      c.climateMs = now + 30000;
+    } else {
+      subscribe(c, now);
+    }
+  }
+}
+
+static void record(const Connection &conn, int status, uint64_t now) {
+  RouteStats &s = stats[conn.route];
+  if (status == 0) {
+    s.failed++;
+    return;
+  }
+  s.latencies.push_back(now - conn.madeMs);
+  s.bytes += conn.bytes;
+  if (status == 304) s.notModified++;
+}
+
+// Requests that can get a connection get one, the rest wait for the browser's next SYN
+static void accept(uint64_t now) {
+  for (auto it = backlog.begin(); it != backlog.end();) {
+    if (it->tryMs > now || it->client->connections >= BROWSER_CONNECTIONS) {
+      ++it;
+      continue;
+    }
+    std::unique_ptr<Connection> conn(new Connection());
+    if (connections.size() >= options.connections || !open(*conn)) {
+      for (int b : conn->blocks) heap::release(b);
+      if (++it->tries > SYN_RETRIES) {
+        stats[it->route].failed++;
+        it = backlog.erase(it);
+      } else {
+        it->tryMs = now + (1000UL << (it->tries - 1));
+        ++it;
+      }
+      continue;
+    }
+    conn->client = it->client;
+    it->client->connections++;
+    conn->route = it->route;
+    conn->url = it->url;
+    conn->madeMs = it->madeMs;
+    std::vector<std::pair<std::string, std::string>> headers;
+    auto etag = it->client->etags.find(it->url);
+    if (etag != it->client->etags.end()) headers.emplace_back("If-None-Match", etag->second);
+    conn->exchange = http::begin("GET", it->url, headers);
+    conn->blocks.push_back(heap::alloc(RESPONSE_BYTES));
+    connections.push_back(std::move(conn));
+    it = backlog.erase(it);
+  }
+}
+
+// Put the next segment on the wire; false if the connection has nothing it can send now
+static bool send(Connection &conn, uint64_t now) {
+  uint32_t room = std::min(SND_BUF - conn.unacked, MSS);
+  if (room == 0) return false;
+  size_t bytes = 0;
+  if (conn.events) {
+    bytes = std::min<size_t>(conn.events->received.size() - conn.eventsSent, room);
+    conn.eventsSent += bytes;
+  } else {
+    http::Exchange &ex = *conn.exchange;
+    if (ex.done) return false;
+    // ESPAsyncWebServer mallocs a buffer the size of the window to fill, copies it into pbufs and frees it
+    int buffer = heap::alloc(room);
+    if (buffer < 0) {
+      stalls++;
+      return false;
+    }
+    size_t before = ex.wireBytes;
+    ex.pump(room);
+    heap::release(buffer);
+    bytes = ex.wireBytes - before;
+    if (!conn.headersSent) {
+      bytes += 19; // "HTTP/1.1 200 OK\r\n" ... "\r\n"
+      for (auto &h : ex.headers) bytes += h.first.size() + h.second.size() + 4;
+      conn.headersSent = true;
+    }
+  }
+  if (bytes == 0) return false;
+  conn.inFlight.push_back({ now + RTT_MS, heap::alloc(bytes + PBUF_OVERHEAD), (uint32_t)bytes });
+  conn.unacked += bytes;
+  conn.bytes += bytes;
+  tokens -= bytes;
+  return true;
+}
+
+void tick() {
+  uint64_t now = millis();
+  if (!started) {
+    if (!http::server || !http::server->_begun || clients.empty()) return;
+    started = true;
+    startMs = lastMs = now;
+    fs::Dir dir = SPIFFS.openDir("/www/a/");
+    while (dir.next()) {
+      String name = dir.fileName();
+      if (name.endsWith(".gz")) name = name.substring(0, name.length() - 3);
+      assets.push_back(std::string("/a/") + (name.c_str() + name.lastIndexOf('/') + 1));
+    }
+    for (size_t i = 0; i < clients.size(); i++) { // spread the first loads over 10 s
+      clients[i].loadMs = now + i * 10000 / clients.size();
+    }
+  }
+  tokens = std::min<int64_t>(tokens + (now - lastMs) * LINK_BYTES_PER_MS, (int64_t)SND_BUF * options.connections);
+  lastMs = now;
+
+  for (auto &c : clients) {
+    if (now >= c.loadMs) load(c, now);
+    if (now >= c.eventsMs) subscribe(c, now);
+    if (now >= c.tableMs) {
+      issue(c, "/table page", tablePage(c), now);
+      c.tableMs += 60000;
+    }
+    if (now >= c.co2Ms) {
+      issue(c, "/co2", "/co2", now);
+      c.co2Ms += 5000;
+    }
+    if (now >= c.climateMs) {
+      issue(c, "/temp", "/temp", now);
+      issue(c, "/humidity", "/humidity", now);
+      c.climateMs += 30000;
+    }
+  }
+  accept(now);
+
+  for (auto &conn : connections) {
+    while (!conn->inFlight.empty() && conn->inFlight.front().ackMs <= now) {
+      heap::release(conn->inFlight.front().block);
+      conn->unacked -= conn->inFlight.front().bytes;
+      conn->inFlight.pop_front();
+    }
+  }
+  // a segment each, round and round, while the link has room
+  bool sent = true;
+  while (tokens > 0 && sent) {
+    sent = false;
+    for (auto &conn : connections) {
+      if (tokens <= 0) break;
+      sent |= send(*conn, now);
+    }
+  }
+
+  for (auto it = connections.begin(); it != connections.end();) {
+    Connection *conn = it->get();
+    ++it;
+    if (conn->events || !conn->exchange->done || !conn->inFlight.empty()) continue;
+    record(*conn, conn->exchange->status, now);
+    loaded(*conn->client, *conn, now);
+    close(conn);
+  }
+}
+
+static uint32_t percentile(std::vector<uint32_t> &v, uint32_t pct) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, v.size() * pct / 100)];
+}
+
+void report() {
+  if (!started) {
+    printf("load: the web server never started\n");
+    return;
+  }
+  double seconds = (millis() - startMs) / 1000.0;
+  printf("load: %u dashboards (%u polling), %u connections, reload every %u min, %.0f s\n", options.clients,
+         options.polling, options.connections, options.reloadMinutes, seconds);
+  printf("%-14s %8s %8s %8s %8s %11s %6s %7s\n", "route", "requests", "req/s", "p50 ms", "p99 ms", "bytes/resp", "304s", "failed");
+  uint32_t total = 0, failed = 0;
+  for (auto &r : stats) {
+    RouteStats &s = r.second;
+    uint32_t n = s.latencies.size();
+    total += n;
+    failed += s.failed;
+    printf("%-14s %8u %8.2f %8u %8u %11.0f %6u %7u\n", r.first.c_str(), n, n / seconds, percentile(s.latencies, 50),
+           percentile(s.latencies, 99), n ? (double)s.bytes / n : 0.0, s.notModified, s.failed);
+  }
+  printf("%-14s %8u %8.2f %37s %7u\n", "total", total, total / seconds, "", failed);
+  printf("/events: %u subscriptions, %u refused for want of a connection, %llu bytes pushed\n", eventsSubscribed,
+         eventsRefused, (unsigned long long)http::eventBytes());
+  printf("heap: %u bytes free at the lowest, largest block down to %u, fragmentation up to %u%%, %u failed allocations, %u stalled sends\n",
+         heap::minFree, heap::minMaxBlock, heap::maxFragmentation, heap::failures, stalls);
+}
+
+} // namespace load
+} // namespace sim
@@ -0,0 +1,46 @@
+/*
+
+Load generator for the simulator: N dashboards open on the badge at once,
+each doing what web/index.html and main.js do, against the routes the
+firmware registered in setup().
+
+A dashboard loads / (revalidated with If-None-Match after the first visit,
+when it also fetches every asset under /a/), then the first page of /table
+(DataTables' server-side processing, 10 rows), then either
+subscribes to /events or, for the polling clients (browsers without
+EventSource), fetches /co2 every 5 s and /temp and /humidity every 30 s.
+Every 60 s it asks for that page again. Every reloadMinutes it
+does the whole thing again.
+
+The network is modelled on the ESP8266's lwIP defaults: a handful of TCP
+connections (an /events subscriber keeps one for good), 536 byte segments
+with two in flight per connection, a shared link and a fixed round trip.
+Each connection, request, response and unacknowledged segment takes
+blocks from sim::heap, roughly the sizes ESPAsyncWebServer and lwIP
+allocate, so the heap numbers are an estimate of the shape rather than a
+measurement. Latency is virtual time from the request being made (by the
+browser, so waiting for a free connection counts) to the last byte being
+acknowledged.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+namespace sim {
+namespace load {
+
+  struct Options {
+    uint32_t clients = 0;
+    uint32_t polling = 0;       // how many of them poll instead of using /events
+    uint32_t reloadMinutes = 5; // 0: load the page once
+    uint8_t connections = 5;    // lwIP's MEMP_NUM_TCP_PCB on the ESP8266
+  };
+
+  void start(const Options &options);
+  // Move the clients and the network on to the current virtual time; call between loop()s
+  void tick();
+  void report();
+
+} // namespace load
+} // namespace sim
@@ -0,0 +1,179 @@
+/*
+
+Simulator driver: runs the firmware's setup()/loop() against the host
+stand-ins on a virtual clock.
+
+The filesystem is a host directory (--fs, default sim_fs). If it has no
+fonts yet it is seeded from the data/ directory, like uploading the
+filesystem image; www/ is refreshed from data/www on every run.
+
+  co2sim [--minutes N] [--fs DIR] [--quiet] [--header "Name: value"]... [--get URL]... [--screenshot FILE.ppm] [--events N]
+         [--ap-down MINUTES] [--collector-down MINUTES] [--trace FILE [--speedup N]]
+         [--load N [--load-polling N] [--load-reload MINUTES] [--load-connections N]]
+
+--ap-down keeps the access point unreachable for the first MINUTES.
+
+With UPLINK_URL set in settings.h the uplink sends to a stand-in collector
+(see collector.h) whatever the URL's host, and its totals are printed at the
+end. --collector-down refuses its connections for the first MINUTES.
+
+--trace replays a sensor trace (lib/SCD30_Fake/SCD30_Trace.h) from the host
+FILE instead of made-up readings, N times faster than it was recorded. The
+clock is virtual, so at the default 1x a week's trace still runs in seconds
+and every run gives the same readings.
+
+--load opens N dashboards on the badge, of which --load-polling poll
+instead of subscribing to /events, each reloading every --load-reload
+minutes (default 5), over --load-connections TCP connections (default 5),
+and reports requests/s, latency, response sizes and the heap (see load.h).
+
+*/
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include <FS.h>
+#include <ESPAsyncWebServer.h>
+#include <ESP8266WiFi.h>
+#include <ESPAsyncTCP.h>
+#include <SCD30_Fake.h>
+#include "load.h"
+#include "collector.h"
+
+#include <chrono>
+#include <filesystem>
+
+void setup();
+void loop();
+extern TFT_eSPI tft;
+extern SCD30_Fake airSensor;
+
+// Dump the panel as a binary PPM
+static void screenshot(const std::string &path) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) return;
+  fprintf(f, "P6\n%d %d\n255\n", tft.width(), tft.height());
+  for (int i = 0; i < tft.width() * tft.height(); i++) {
+    uint16_t c = tft.frame()[i];
+    uint8_t rgb[3] = { (uint8_t)((c >> 8) & 0xF8), (uint8_t)((c >> 3) & 0xFC), (uint8_t)(c << 3) };
+    fwrite(rgb, 1, 3, f);
+  }
+  fclose(f);
+}
+
+static void usage() {
+  printf("usage: co2sim [--minutes N] [--fs DIR] [--quiet] [--header \"Name: value\"]... [--get URL]... [--screenshot FILE.ppm] [--events N] [--ap-down MINUTES]\n"
+         "              [--collector-down MINUTES] [--trace FILE [--speedup N]] [--load N [--load-polling N] [--load-reload MINUTES] [--load-connections N]]\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t minutes = 60;
+  bool quiet = false;
+  std::vector<std::string> gets;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string shot;
+  uint32_t subscribers = 0;
+  std::string trace;
+  uint16_t speedup = 1;
+  sim::load::Options load;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--minutes" && i + 1 < argc) {
+      minutes = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--fs" && i + 1 < argc) {
+      sim::fsRoot = argv[++i];
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else if (arg == "--events" && i + 1 < argc) {
+      subscribers = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--ap-down" && i + 1 < argc) {
+      sim::apDownUntilMs = strtoul(argv[++i], nullptr, 10) * 60 * 1000;
+    } else if (arg == "--collector-down" && i + 1 < argc) {
+      sim::collector::downUntilMs = strtoul(argv[++i], nullptr, 10) * 60 * 1000;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace = argv[++i];
+    } else if (arg == "--speedup" && i + 1 < argc) {
+      speedup = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--load" && i + 1 < argc) {
+      load.clients = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--load-polling" && i + 1 < argc) {
+      load.polling = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--load-reload" && i + 1 < argc) {
+      load.reloadMinutes = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--load-connections" && i + 1 < argc) {
+      load.connections = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--screenshot" && i + 1 < argc) {
+      shot = argv[++i];
+    } else if (arg == "--header" && i + 1 < argc) {
+      std::string h = argv[++i];
+      size_t colon = h.find(':');
+      headers.emplace_back(h.substr(0, colon), h.substr(h.find_first_not_of(' ', colon + 1)));
+    } else if (arg == "--get" && i + 1 < argc) {
+      gets.push_back(argv[++i]);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  namespace fsys = std::filesystem;
+  if (!fsys::exists(fsys::path(sim::fsRoot) / "fonts") && fsys::exists("data")) {
+    fsys::copy("data", sim::fsRoot, fsys::copy_options::recursive | fsys::copy_options::skip_existing);
+  }
+  if (fsys::exists("data/www")) { // the web pages are rebuilt by tools/build_www.py, always take the latest
+    fsys::remove_all(fsys::path(sim::fsRoot) / "www");
+    fsys::copy("data/www", fsys::path(sim::fsRoot) / "www", fsys::copy_options::recursive);
+  }
+
+  if (!trace.empty()) { // the firmware reads it through SPIFFS, so it goes in the filesystem
+    fsys::create_directories(sim::fsRoot);
+    fsys::copy_file(trace, fsys::path(sim::fsRoot) / "replay.bin", fsys::copy_options::overwrite_existing);
+    airSensor.replay("/replay.bin", speedup);
+  }
+
+  Serial.enabled = !quiet;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  setup();
+  sim::load::start(load);
+  std::vector<AsyncEventSourceClient *> clients;
+  for (uint32_t i = 0; i < subscribers; i++) {
+    clients.push_back(sim::http::subscribe("/events"));
+  }
+  uint64_t loops = 0;
+  uint64_t endUs = sim::clockUs + (uint64_t)minutes * 60 * 1000000;
+  while (sim::clockUs < endUs) {
+    uint64_t before = sim::clockUs;
+    loop();
+    if (load.clients) sim::load::tick();
+    AsyncClient::tick();
+    // a loop() that never sleeps would otherwise stall virtual time
+    if (sim::clockUs == before) sim::clockUs += 1000;
+    loops++;
+  }
+
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+  Serial.enabled = true;
+
+  if (!shot.empty()) screenshot(shot);
+
+  for (auto &url : gets) {
+    auto ex = sim::http::get(url, headers);
+    printf("GET %s -> %d (%zu bytes)\n", url.c_str(), ex->status, ex->body.size());
+    for (auto &h : ex->headers) printf("%s: %s\n", h.first.c_str(), h.second.c_str());
+    fwrite(ex->body.data(), 1, ex->body.size(), stdout); // binary bodies too
+    putchar('\n');
+  }
+
+  if (subscribers && clients[0]) {
+    const std::string &r = clients[0]->received;
+    printf("events: %u subscribers, %llu bytes queued in total, last message:\n%s", subscribers,
+           (unsigned long long)sim::http::eventBytes(), r.substr(r.rfind("\r\n\r\n", r.size() - 5) + 4).c_str());
+  }
+  if (load.clients) sim::load::report();
+  if (sim::collector::used()) sim::collector::report();
+  printf("simulated %u min in %.1f ms wall, %llu loop() calls\n", minutes, wallMs, (unsigned long long)loops);
+  printf("tft: %llu pixels, %llu SPI bytes, %llu transactions, %llu font loads\n",
+         (unsigned long long)sim::tft.pixels, (unsigned long long)sim::tft.spiBytes,
+         (unsigned long long)sim::tft.transactions, (unsigned long long)sim::tft.fontLoads);
+  return 0;
+}
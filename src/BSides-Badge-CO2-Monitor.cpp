@@ -18,17 +18,31 @@
 #include <FS.h>
 #include <Wire.h>
 #include <SparkFun_SCD30_Arduino_Library.h>
-#include <CircularBuffer.h>
 #include <jled.h>
 #include <ESP8266WiFi.h>
 #include <ESPAsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <ESP8266mDNS.h>
-#include <ArduinoJson.h>
-#include <AsyncJson.h>
 
 // User configurations
 #include "settings.h"
+#include "history.h"
+#include "flashlog.h"
+#include "table.h"
+#include "decimate.h"
+#include "glyphcache.h"
+#include "graph.h"
+#include "scheduler.h"
+#include "metrics.h"
+#include "wifilink.h"
+#include "stats.h"
+#include "format.h"
+#include "forecast.h"
+#include "uplink.h"
+#include "spicount.h"
+#include "gzip.h"
+#include <memory>
+#include <SCD30_Trace.h>
 
 #define LED_PIN D8
 #define ONE_HOUR 3600000UL
@@ -37,7 +51,43 @@
 #define AA_FONT_LARGE "fonts/NotoSansBold36"
 TFT_eSPI tft = TFT_eSPI();
 
-#if FAKE_SENSOR
+// The readings are drawn from glyphs cached in RAM rather than loadFont() every loop,
+// each in a box that only sends the pixels that changed
+GlyphCache largeGlyphs;
+GlyphCache smallGlyphs;
+CachedText co2Text(largeGlyphs, 65, 4, TC_DATUM, 120); // x-axis: 65 (half of 130px), y-axis: 4 (any lower and the box crops the top of the "2k"); "10,000" is 115px
+CachedText tempText(smallGlyphs, 22, 112, TL_DATUM, 68); // up to where the humidity starts
+CachedText humidityText(smallGlyphs, 92, 112, TL_DATUM, 22); // up to the icon
+
+#ifndef ALARM_LEAD // for settings.h from before the options existed
+  #define ALARM_LEAD 10
+#endif
+#ifndef ALARM_HYSTERESIS
+  #define ALARM_HYSTERESIS 100
+#endif
+#ifndef TRACE_RECORD
+  #define TRACE_RECORD false
+#endif
+#ifndef TRACE_REPLAY
+  #define TRACE_REPLAY ""
+#endif
+#ifndef TRACE_SPEEDUP
+  #define TRACE_SPEEDUP 1
+#endif
+#ifndef UPLINK_URL
+  #define UPLINK_URL ""
+#endif
+#ifndef UPLINK_INTERVAL
+  #define UPLINK_INTERVAL 300
+#endif
+#define TRACE_FILE "/trace.bin"
+#define TRACE_MAX_BYTES (512 * 1024UL) // about three days; what's left of the 1 MB filesystem holds the log & web pages
+
+#if TRACE_RECORD
+  TraceWriter traceWriter;
+#endif
+
+#if FAKE_SENSOR || NATIVE_SIM // the simulator has no I2C bus, so it always fakes it
   #include <SCD30_Fake.h>
   SCD30_Fake airSensor;
 #else
@@ -45,6 +95,7 @@ TFT_eSPI tft = TFT_eSPI();
 #endif
 
 AsyncWebServer server(80);
+AsyncEventSource events("/events"); // live readings pushed to the dashboards
 
 #define GRAPH_BEG_X 25
 #define GRAPH_END_X 122
@@ -54,10 +105,38 @@ AsyncWebServer server(80);
 // Define LED function when in alarm state
 // LED will fade-on in 150ms, stay on for 400ms, and fade-off in 150ms. Brightness is capped to 50/255
 auto ledAlarm = JLed(LED_PIN).Breathe(150, 400, 150).Repeat(1).MaxBrightness(50);
+// and a short, dim blink every 3s while the trend says it's coming
+auto ledSoon = JLed(LED_PIN).Blink(40, 2960).Forever().MaxBrightness(15);
+
+// Where the CO2 is heading, and the alarm that goes off on it (see forecast.h)
+TrendForecast co2Trend;
+Alarm co2Alarm(LED_ALARM, ALARM_HYSTERESIS, ALARM_LEAD * 60);
+int32_t alarmEta = -1; // seconds until the trend reaches LED_ALARM, -1 if it isn't heading there
 
 // Globals for storing the most recent measurements
 uint16_t lastCo2 = 0;
-float lastTemp, lastHumidity = 0.00;
+int16_t lastTemp = 0; // centi-degrees C, like everything downstream (see history.h)
+uint16_t lastHumidity = 0; // centi-percent RH
+
+// /settings, put together by the compiler from settings.h and kept in flash. The
+// strings go in as they are, so keep quotes and backslashes out of them.
+#define SETTING_STR(x) #x
+#define SETTING(x) SETTING_STR(x)
+static const char SETTINGS_JSON[] PROGMEM = "{\"data\":["
+  "[\"WIFI_SSID\",\"" WIFI_SSID "\"],"
+  "[\"WIFI_PW\",\"********\"],"
+  "[\"TIMEZONE\",\"" TIMEZONE "\"],"
+  "[\"DEBUG\"," SETTING(DEBUG) "],"
+  "[\"FAKE_SENSOR\"," SETTING(FAKE_SENSOR) "],"
+  "[\"TRACE_RECORD\"," SETTING(TRACE_RECORD) "],"
+  "[\"ALTITUDE_ABOVE_SEA\"," SETTING(ALTITUDE_ABOVE_SEA) "],"
+  "[\"PPM_YELLOW\"," SETTING(PPM_YELLOW) "],"
+  "[\"PPM_ORANGE\"," SETTING(PPM_ORANGE) "],"
+  "[\"PPM_RED\"," SETTING(PPM_RED) "],"
+  "[\"LED_ALARM\"," SETTING(LED_ALARM) "],"
+  "[\"ALARM_LEAD\"," SETTING(ALARM_LEAD) "],"
+  "[\"ALARM_HYSTERESIS\"," SETTING(ALARM_HYSTERESIS) "]"
+  "]}";
 
 //====================================================================================
 // This next function will be called during decoding of the jpeg file to
@@ -78,61 +157,85 @@ void setTimezone(String timezone){
   tzset();
 }
 
-int getYOffset(uint16_t co2) {
-  // take co2 value and determine the Y axis offset
-  // 50 pixel offset = 2000ppm
-  int val = map(co2, 0, 2000, 0, (GRAPH_END_Y-GRAPH_BEG_Y));
-  if (val > 50) {
-    val = 50; // to stop >2000ppm from yeeting off the graph
+// Colour for a CO2 reading, on the big number and the graph
+uint16_t co2Colour(uint16_t co2) {
+  if (co2 >= PPM_RED) {
+    return TFT_RED;
+  } else if (co2 >= PPM_ORANGE) {
+    return TFT_ORANGE;
+  } else if (co2 >= PPM_YELLOW) {
+    return TFT_YELLOW;
   }
-  return val;
+  return TFT_WHITE;
 }
 
-CircularBuffer<uint16_t,(GRAPH_END_X-GRAPH_BEG_X-1)> measurement; // we -1 to not clash with our end x axis line
-void updGraph(uint16_t co2) {
-  if (DEBUG) { Serial.println("Updating TFT graph data"); }
-  measurement.push(co2); // take the most current co2 reading and push to CircularBuffer
-
-  tft.fillRect(GRAPH_BEG_X+1, GRAPH_BEG_Y, (GRAPH_END_X-GRAPH_BEG_X-1), (GRAPH_END_Y-GRAPH_BEG_Y+1), TFT_BLACK); // clear TFT area before plotting
-
-  for (int xOffset=0; xOffset<measurement.size(); xOffset++) { // plot all values in CircularBuffer
-    uint16_t co2Value = measurement[xOffset];
-    int xValue = GRAPH_BEG_X + 1 + xOffset; // we +1 here so that xValue doesn't clash with our x axis line
-    int yValue = GRAPH_END_Y - getYOffset(co2Value);
+#ifndef GRAPH_STYLE
+  #define GRAPH_STYLE GRAPH_DOTS // for settings.h from before the option existed
+#endif
+#define GRAPH_POINTS (GRAPH_END_X-GRAPH_BEG_X-1) // we -1 to not clash with our end x axis line
+#ifndef GRAPH_MINUTES
+  #define GRAPH_MINUTES GRAPH_POINTS // one sample per column
+#endif
+// 2000ppm at the top; we +1 on x so the plot doesn't clash with our x axis line
+ScrollingGraph graph(GRAPH_BEG_X+1, GRAPH_BEG_Y, GRAPH_POINTS, (GRAPH_END_Y-GRAPH_BEG_Y+1), 2000, GRAPH_STYLE);
 
-    if (co2Value >= PPM_RED) {
-      tft.drawLine(xValue, yValue, xValue, yValue, TFT_RED);
-    } else if (co2Value >= PPM_ORANGE) {
-      tft.drawLine(xValue, yValue, xValue, yValue, TFT_ORANGE);
-    } else if (co2Value >= PPM_YELLOW) {
-      tft.drawLine(xValue, yValue, xValue, yValue, TFT_YELLOW);
-    } else {
-      tft.drawLine(xValue, yValue, xValue, yValue, TFT_WHITE);
+void updGraph() {
+  if (DEBUG) { Serial.println("Updating TFT graph data"); }
+  uint16_t values[GRAPH_POINTS];
+  uint16_t window = history.size() < GRAPH_MINUTES ? history.size() : GRAPH_MINUTES;
+  uint32_t oldest = history.pushed() - window;
+  uint16_t points = window;
+  if (window <= GRAPH_POINTS) {
+    for (uint16_t i = 0; i < points; i++) { // plot the most recent history samples
+      values[i] = history.co2At(oldest + i);
+    }
+  } else { // more samples than columns: keep the ones that give the shape
+    Lttb lttb;
+    lttb.begin(oldest, history.pushed(), GRAPH_POINTS);
+    points = GRAPH_POINTS;
+    for (uint16_t b = 0; b < points; b++) {
+      if (b + 1 < points) {
+        for (uint32_t n = lttb.bucketStart(b + 1); n < lttb.bucketEnd(b + 1); n++) lttb.aim(n, history.co2At(n));
+      }
+      uint32_t kept = lttb.bucketStart(b);
+      for (uint32_t n = kept; n < lttb.bucketEnd(b); n++) {
+        if (lttb.consider(n, history.co2At(n))) kept = n;
+      }
+      values[b] = history.co2At(kept);
+      lttb.next(kept, values[b]);
     }
   }
+  graph.plot(tft, values, points, co2Colour);
+  if (DEBUG) { Serial.printf("Graph pushed %u pixels\n", graph.lastPixels); }
 }
 
-CircularBuffer<time_t,120> timeBuffer; // 180 entries = 3 hours
-CircularBuffer<uint16_t,120> co2Buffer;
-CircularBuffer<float,120> tempBuffer;
-CircularBuffer<float,120> humidityBuffer;
-DynamicJsonDocument json(9920); // 4096 bytes = 51 minutes (9920 = 2 hours)
-char* bigJSON = new char[9920];
-void updTable(uint16_t co2, float temp, float humidity) {
+void updTable(uint16_t co2, int16_t temp, uint16_t humidity) {
   if (DEBUG) { Serial.println("Updating table data"); }
-  timeBuffer.push(time(NULL));
-  co2Buffer.push(co2);
-  tempBuffer.push(temp);
-  humidityBuffer.push(humidity);
-
-  for (int i=0; i<timeBuffer.size(); i++) {
-    json["data"][i][0] = timeBuffer[i];
-    json["data"][i][1] = co2Buffer[i];
-    json["data"][i][2] = tempBuffer[i];
-    json["data"][i][3] = humidityBuffer[i];
+  time_t now = time(NULL);
+  if (now < HISTORY_VALID_TIME) {
+    now = millis() / 1000; // NTP hasn't synced yet: keep the uptime, it's fixed up below once it has
+  } else if (history.size() > 0 && history.lastTime() < HISTORY_VALID_TIME) {
+    // first sample since NTP synced: give the ones recorded before it real times
+    uint32_t first = retimeSamples(now - millis() / 1000);
+    HistoryCursor cursor = history.cursor(first);
+    Sample sample;
+    while (history.read(cursor, sample)) {
+      flashLog.append(sample.time, sample.co2, sample.temp, sample.humidity);
+    }
+    Serial.printf("Clock synced, re-timed %lu samples\n", (unsigned long)(history.pushed() - first));
   }
+  addSample(now, co2, temp, humidity);
+  if (now >= HISTORY_VALID_TIME) { // without NTP we don't know when this was
+    flashLog.append(now, co2, temp, humidity);
+  }
+}
 
-  serializeJson(json, bigJSON, measureJson(json));
+// Load what the flash log remembers from before this boot back into RAM
+void restoreHistory() {
+  uint32_t restored = flashLog.replay([](const Sample &sample) {
+    addSample(sample.time, sample.co2, sample.temp, sample.humidity);
+  });
+  Serial.printf("Restored %lu samples from flash\n", (unsigned long)restored);
 }
 
 // Thanks: https://arduino.stackexchange.com/questions/28603/the-most-effective-way-to-format-numbers-on-arduino
@@ -148,37 +251,138 @@ char *ultoa(unsigned long val, char *s) {
   return p;
 }
 
-void initWiFi() {
-  uint8_t connectionRetries = 0;
-  uint8_t maxConnectionRetries = 30;
-  if (DEBUG) { Serial.println("Attempting to connect to Wi-Fi"); }
-  WiFi.disconnect(true);
-  WiFi.begin(WIFI_SSID, WIFI_PW);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    ++connectionRetries;
-    if (connectionRetries == maxConnectionRetries) {
-      Serial.printf("\nUnable to connect to WiFi after %d tries. Disabling...\n", connectionRetries);
-      Serial.printf("Wi-Fi SSID: %s\n", WIFI_SSID);
-      WiFi.disconnect(true);  // Disconnect from the network
-      WiFi.mode(WIFI_OFF);    // Switch WiFi off
+// The latest reading as a /table row, serialised once and shared by every /events subscriber
+char livePacket[TABLE_ROW_MAX] = "";
+uint32_t readingCount = 0; // event id, so a reconnecting browser can tell if it missed any
+
+// Likewise the bodies of /co2, /temp, /humidity and /api: rendered once per reading and
+// sent straight out of these buffers, so however many clients poll, none of them allocates
+char liveCo2[FORMAT_UNSIGNED_MAX + 1] = "0";
+char liveTemp[FORMAT_CENTI_MAX + 1] = "0.00";
+char liveHumidity[FORMAT_CENTI_MAX + 1] = "0.00";
+char liveApi[320] = "{}";
+
+// /api as of the latest reading, heap included
+void renderApi() {
+  char *p = stpcpy(liveApi, "{\"heap\":");
+  p = appendUnsigned(p, ESP.getFreeHeap());
+  p = stpcpy(p, ",\"co2\":");
+  p = appendUnsigned(p, lastCo2);
+  p = stpcpy(p, ",\"temp\":");
+  p = appendCenti(p, lastTemp, 2);
+  p = stpcpy(p, ",\"humidity\":");
+  p = appendCenti(p, lastHumidity, 2);
+  // the headline numbers of each window, /stats has the rest
+  WindowStats w[STATS_WINDOWS];
+  uint32_t now = statsUptime();
+  for (uint8_t i = 0; i < STATS_WINDOWS; i++) {
+    co2Windows[i].get(now, w[i]);
+  }
+  for (uint8_t field = 0; field < 2; field++) {
+    p = stpcpy(p, field == 0 ? ",\"co2_mean\":{" : ",\"co2_max\":{");
+    for (uint8_t i = 0; i < STATS_WINDOWS; i++) {
+      if (w[i].count == 0) continue;
+      if (p[-1] != '{') *p++ = ',';
+      *p++ = '"';
+      p = stpcpy(p, co2Windows[i].name);
+      p = stpcpy(p, "\":");
+      p = appendUnsigned(p, field == 0 ? (w[i].mean + 5) / 10 : w[i].max);
+    }
+    *p++ = '}';
+  }
+  // the forecast: ppm/min, the alarm's state and how many seconds until each threshold
+  p = stpcpy(p, ",\"trend\":");
+  p = co2Trend.ready() ? appendCenti(p, co2Trend.slope() * 10, 1) : stpcpy(p, "null");
+  p = stpcpy(p, ",\"alarm\":\"");
+  p = stpcpy(p, co2Alarm.name());
+  for (uint8_t i = 0; i < 2; i++) {
+    int32_t eta = i == 0 ? alarmEta : co2Trend.secondsTo(PPM_RED, now);
+    p = stpcpy(p, i == 0 ? "\",\"eta_alarm\":" : ",\"eta_red\":");
+    p = eta >= 0 ? appendUnsigned(p, eta) : stpcpy(p, "null");
+  }
+  *p++ = '}';
+  *p = '\0';
+}
+
+// Send one of the live buffers. The _P response reads the body from where it is
+// (beginResponse() would copy it into a String); a small body is all written out
+// before send() returns, so the next reading can't change it mid-response.
+void sendLive(AsyncWebServerRequest *request, const char *type, const char *body) {
+  AsyncWebServerResponse *response = request->beginResponse_P(200, type, (const uint8_t *)body, strlen(body));
+  response->addHeader("Cache-Control", "no-cache");
+  response->addHeader("Access-Control-Allow-Origin", "*");
+  request->send(response);
+}
+
+// The history as CSV for spreadsheets, from the flash log (or the 15m/1h buckets
+// with ?res=), optionally limited to ?from=&to=. gzipFile sends it as a .csv.gz;
+// otherwise it's gzipped on the way if the client accepts that.
+void sendExport(AsyncWebServerRequest *request, bool gzipFile) {
+  timeRoute(request, "/export.csv");
+  TableSource source = TABLE_LOG;
+  if (request->hasParam("res")) {
+    source = parseResolution(request->getParam("res")->value().c_str());
+    if (source == TABLE_RAW) source = TABLE_LOG; // the log goes back further
+  }
+  time_t from = 0, to = LONG_MAX;
+  if (request->hasParam("from")) from = strtoul(request->getParam("from")->value().c_str(), NULL, 10);
+  if (request->hasParam("to")) to = strtoul(request->getParam("to")->value().c_str(), NULL, 10);
+
+  bool gzip = gzipFile || (request->hasHeader("Accept-Encoding") && strstr(request->getHeader("Accept-Encoding")->value().c_str(), "gzip"));
+  std::shared_ptr<GzipStream> gz; // shared by the copies of the callback, freed with the last
+  if (gzip) {
+    gz = std::make_shared<GzipStream>();
+    if (!gz->begin()) {
+      request->send(503, "text/plain", "Not enough memory to compress, try again");
       return;
     }
-    delay(500);
   }
-  Serial.print("Connected, IP address: ");
-  Serial.println(WiFi.localIP());
-  WiFi.setAutoReconnect(true);
-  WiFi.persistent(true);
+  TableCursor cursor = beginTable(source, from, to, TABLE_CSV);
+  AsyncWebServerResponse *response = request->beginChunkedResponse(gzipFile ? "application/gzip" : "text/csv", [cursor, gz](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+    return getCSVChunk((char *)buffer, (int)maxLen, cursor, gz.get());
+  });
+  if (gzip && !gzipFile) {
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("Vary", "Accept-Encoding");
+  response->addHeader("Content-Disposition", gzipFile ? "attachment; filename=\"" HOSTNAME ".csv.gz\"" : "attachment; filename=\"" HOSTNAME ".csv\"");
+  response->addHeader("Cache-Control", "no-cache");
+  response->addHeader("Access-Control-Allow-Origin", "*");
+  request->send(response);
+}
+
+void publishReading() {
+  Sample sample = { time(NULL), lastCo2, lastTemp, lastHumidity };
+  formatSample(livePacket, sizeof(livePacket), sample);
+  *appendUnsigned(liveCo2, lastCo2) = '\0';
+  *appendCenti(liveTemp, lastTemp, 2) = '\0';
+  *appendCenti(liveHumidity, lastHumidity, 2) = '\0';
+  renderApi();
+  readingCount++;
+  if (events.count() > 0) {
+    events.send(livePacket, "reading", readingCount);
+  }
 }
 
 void updateReadings() {
+  uint32_t start = micros();
   if (airSensor.dataAvailable()) { // check if update available
     // so i thought this was going to need to be atomic/async safe to avoid race conditions
     // but it turns out trying to do that causes way more problems lol
     lastCo2 = airSensor.getCO2();
-    lastTemp = airSensor.getTemperature();
-    lastHumidity = airSensor.getHumidity();
+    // the SCD30 hands over floats; this is the only place they're touched
+    lastTemp = lroundf(airSensor.getTemperature() * 100);
+    lastHumidity = lroundf(airSensor.getHumidity() * 100);
+#if TRACE_RECORD
+    traceWriter.append(millis(), lastCo2, lastTemp, lastHumidity);
+#endif
+    metrics.sensorRead(micros() - start);
+    addStatsReading(lastCo2);
+    uint32_t now = statsUptime();
+    co2Trend.add(now, lastCo2);
+    alarmEta = co2Trend.secondsTo(co2Alarm.threshold, now);
+    co2Alarm.update(lastCo2, alarmEta);
+    publishReading();
   } else {
     if (lastCo2 == 0) {
       Serial.println("A call to updateReadings() was made before the senor had populated the lastReading struct...");
@@ -186,26 +390,6 @@ void updateReadings() {
   }
 }
 
-int getJSONChunk(char *buffer, int maxLen, size_t index) {
-  //Write up to "maxLen" bytes into "buffer" and return the amount written.
-  //index equals the amount of bytes that has been already sent
-  //You will be asked for more data until 0 is returned
-  int sizeBigJSON = measureJson(json);
-  size_t max = (ESP.getFreeHeap() / 3) & 0xFFE0;
-  // Get the chunk based on the index and maxLen
-  size_t len = sizeBigJSON - index;
-  if (len > maxLen) len = maxLen;
-  if (len > max) len = max;
-  if (len > 0) {
-    if (DEBUG) { Serial.printf("Adding %i bytes to buffer\n", len); }
-    memcpy(buffer, bigJSON + index, len);
-  }
-  if (len == 0) {
-    if (DEBUG) { Serial.println("Complete buffer sent."); }
-  }
-  return len; // Return the actual length of the chunk (0 for end of file)
-};
-
 /*
 This function doesn't work because we can't (currently) control the backlight of the TFT screen
 on the BSides badge :( This function turns the whole screen white during the "off" period.
@@ -233,6 +417,140 @@ void tftSleep() {
   }
 }
 
+#if !FAKE_SENSOR
+unsigned long MinuteCounter = (60*1000L); // for graph timer
+#else
+unsigned long MinuteCounter = (5*1000L); // Also make time go faster
+#endif
+char co2StringBuffer[14];
+
+// The line under the graph: when the alarm is coming, or that it's on. Small
+// enough for the built-in font, and only drawn when it changes.
+void updForecastLine() {
+  static char shown[24] = "";
+  char line[24];
+  char *p = line;
+  uint16_t colour = TFT_ORANGE;
+  if (co2Alarm.level() == ALARM_SOON) {
+    p = appendUnsigned(p, co2Alarm.threshold);
+    if (alarmEta < 60) {
+      p = stpcpy(p, " ppm in <1 min");
+    } else {
+      p = stpcpy(p, " ppm in ~");
+      p = appendUnsigned(p, (alarmEta + 59) / 60);
+      p = stpcpy(p, " min");
+    }
+  } else if (co2Alarm.level() == ALARM_ON) {
+    p = stpcpy(p, "over ");
+    p = appendUnsigned(p, co2Alarm.threshold);
+    p = stpcpy(p, " ppm");
+    colour = TFT_RED;
+  }
+  *p = '\0';
+  if (strcmp(line, shown) == 0) {
+    return;
+  }
+  strcpy(shown, line);
+  // Centred, and drawn a piece at a time rather than with drawString() so each
+  // window pushed is one counted here: the clear space either side, then in
+  // the built-in 6x8 font each character is a window of its own (with a
+  // background colour set)
+  int16_t y = GRAPH_END_Y + 2;
+  uint8_t len = strlen(line);
+  if (len > tft.width() / 6) len = tft.width() / 6; // (it never is, but only what fits is drawn)
+  int16_t w = len * 6;
+  int16_t left = (tft.width() - w) / 2;
+  int16_t right = tft.width() - left - w;
+  if (left > 0) {
+    tft.fillRect(0, y, left, 8, TFT_BLACK);
+    spiCount.window(left * 8);
+  }
+  if (right > 0) {
+    tft.fillRect(left + w, y, right, 8, TFT_BLACK);
+    spiCount.window(right * 8);
+  }
+  tft.setTextFont(1);
+  tft.setTextColor(colour, TFT_BLACK);
+  for (uint8_t i = 0; i < len; i++) {
+    tft.drawChar(line[i], left + i * 6, y, 1);
+    spiCount.window(6 * 8);
+  }
+}
+
+// Tasks for the scheduler, see setup() for how often each one runs
+
+void updDisplay() {
+  // convert uint into string with "," on >=1000; only drawn when it changes
+  co2Text.update(tft, ultoa(lastCo2, co2StringBuffer), co2Colour(lastCo2));
+
+  char reading[16];
+  // Temp
+  strcpy(appendCenti(reading, lastTemp, 1), " °C");
+  tempText.update(tft, reading, TFT_WHITE);
+  // Humidity
+  *appendCenti(reading, lastHumidity, 0) = '\0';
+  humidityText.update(tft, reading, TFT_WHITE);
+
+  updForecastLine();
+
+  // for serial plotter
+  //Serial.println(lastCo2);
+}
+
+void updHistory() { // the first run is soon after boot so we don't have to wait a minute for a plot
+  if (lastCo2 == 0) {
+    return; // no reading yet, don't record a zero
+  }
+  updTable(lastCo2, lastTemp, lastHumidity);
+  updGraph();
+  // tftSleep();
+}
+
+void updLed() {
+  switch (co2Alarm.level()) {
+  case ALARM_ON:
+    ledSoon.Stop();
+    if (!ledAlarm.IsRunning()) {
+      ledAlarm.Reset();
+    }
+    ledAlarm.Update();
+    break;
+  case ALARM_SOON:
+    ledAlarm.Stop();
+    if (!ledSoon.IsRunning()) {
+      ledSoon.Reset();
+    }
+    ledSoon.Update();
+    break;
+  default:
+    ledAlarm.Stop();
+    ledSoon.Stop();
+  }
+}
+
+void updNetwork() {
+  if (ENABLE_WIFI) {
+    wifiLink.update();
+    if (wifiLink.up()) MDNS.update();
+    if (wifiLink.up() && uplink.enabled()) uplink.update();
+  }
+}
+
+// Runs once Wi-Fi first connects, see wifilink.h
+void startNetworkServices() {
+  if (MDNS.begin(HOSTNAME)) {
+    MDNS.addService("http", "tcp", 80);
+    Serial.printf("MDNS responder started: http://%s\n", HOSTNAME);
+  }
+
+  // NTP syncs in the background; updTable() re-times the samples taken until then
+  configTime(0, 0, NTP_SERVER);
+  setTimezone(TIMEZONE);
+  Serial.printf("Timezone set to: %s\n", TIMEZONE);
+
+  server.begin();
+}
+
 void setup(void) {
   Serial.begin(115200);
   Serial.println("");
@@ -253,6 +571,12 @@ void setup(void) {
     while(1) yield();
   }
 
+  // keep just the glyphs the readings need
+  if (!largeGlyphs.load("/" AA_FONT_LARGE ".vlw", "0123456789,") || !smallGlyphs.load("/" AA_FONT_SMALL ".vlw", "0123456789.-°C%")) {
+    Serial.println("\r\nUnable to cache font glyphs!");
+    while(1) yield();
+  }
+
   // start JPG decoder
   tft.setSwapBytes(true); // We need to swap the colour bytes (endianess)
   TJpgDec.setCallback(tft_output); // The decoder must be given the exact name of the rendering function above
@@ -288,99 +612,182 @@ void setup(void) {
 
   tft.unloadFont();
 
-  // start Wi-Fi connection
-  if (ENABLE_WIFI) {
-    tft.loadFont(AA_FONT_SMALL);
-    tft.setTextColor(TFT_WHITE, TFT_BLACK);
-    tft.setTextDatum(1);
-    tft.drawString("Connecting", 65, 4);
-    tft.drawString("WiFi (15 sec)", 65, 22);
-    tft.unloadFont();
+  // start SCD30 sensor straight after the display, so recording doesn't wait on the network
+  Wire.begin(SCD30_SDA, SCD30_SCL);
+  if (!airSensor.begin()) {
+    Serial.println("SCD30 not detected. Please check wiring. Freezing...");
+    while (1);
+  }
 
-    initWiFi();
+  airSensor.setAltitudeCompensation(ALTITUDE_ABOVE_SEA); // tell SCD30 our altitude
+
+  // print various sensor information
+  Serial.print("Auto calibration set to: ");
+  if (airSensor.getAutoSelfCalibration() == true) {
+    Serial.println("true");
+  } else {
+    Serial.println("false");
   }
 
-  // start mDNS
-  if (ENABLE_WIFI && MDNS.begin(HOSTNAME)) {
-    MDNS.addService("http", "tcp", 80);
-    Serial.printf("MDNS responder started: http://%s\n", HOSTNAME);
+  int interval = airSensor.getMeasurementInterval();
+  Serial.print("Measurement Interval: "); Serial.println(interval);
+
+  unsigned int altitude = airSensor.getAltitudeCompensation();
+  Serial.print("Current altitude: "); Serial.print(altitude); Serial.println("m");
+
+  float offset = airSensor.getTemperatureOffset();
+  Serial.print("Current temp offset: "); Serial.print(offset, 2); Serial.println(" C");
+
+#if FAKE_SENSOR || NATIVE_SIM
+  if (TRACE_REPLAY[0] != '\0' && !airSensor.replaying()) { // (the simulator's --trace gets in first)
+    airSensor.replay(TRACE_REPLAY, TRACE_SPEEDUP);
+  }
+  if (airSensor.replaying()) {
+    MinuteCounter = 60 * 1000L / airSensor.speedup(); // a history sample per minute of the trace
+    Serial.printf("Replaying a sensor trace at %ux\n", airSensor.speedup());
   }
+#endif
+
+  // the history comes back once the display and sensor are up, so they don't wait on it
+  if (!flashLog.begin()) {
+    Serial.println("Flash log could not be opened, history will not survive a reboot");
+  }
+  restoreHistory();
+  if (ENABLE_WIFI && UPLINK_URL[0] && !uplink.begin(UPLINK_URL, UPLINK_INTERVAL * 1000UL)) {
+    Serial.printf("Uplink URL %s is not http://host[:port]/path, not sending\n", UPLINK_URL);
+  }
+#if TRACE_RECORD
+  if (!traceWriter.begin(SPIFFS, TRACE_FILE, TRACE_MAX_BYTES)) {
+    Serial.println("Trace file could not be opened, not recording");
+  }
+#endif
 
   // define HTTP routes
   SPIFFS.begin();
+  // tools/build_www.py gzips everything and names the assets after their content, so
+  // those can be cached for good; the pages are revalidated (a 304 unless re-flashed)
+  server.serveStatic("/a/", SPIFFS, "/www/a/").setCacheControl("public, max-age=31536000, immutable");
   server.serveStatic("/", SPIFFS, "/www/").setDefaultFile("index.html").setCacheControl("no-cache");
 
+  // every route's /metrics series from the start, rather than from its first request
+  static const char *const ROUTES[] = { "/co2", "/temp", "/humidity", "/api", "/stats", "/table", "/export.csv", "/settings", "/admin", "/tasks", "/metrics" };
+  for (const char *path : ROUTES) {
+    metrics.addRoute(path);
+  }
+
   server.on("/co2", HTTP_GET, [](AsyncWebServerRequest *request) {
-    String co2String = String(lastCo2);
-    request->send(200, "text/plain", co2String);
+    timeRoute(request, "/co2");
+    sendLive(request, "text/plain", liveCo2);
   });
 
   server.on("/temp", HTTP_GET, [](AsyncWebServerRequest *request) {
-    String tempString = String(lastTemp);
-    request->send(200, "text/plain", tempString);
+    timeRoute(request, "/temp");
+    sendLive(request, "text/plain", liveTemp);
   });
 
   server.on("/humidity", HTTP_GET, [](AsyncWebServerRequest *request) {
-    String humidString = String(lastHumidity);
-    request->send(200, "text/plain", humidString);
+    timeRoute(request, "/humidity");
+    sendLive(request, "text/plain", liveHumidity);
   });
 
+  events.onConnect([](AsyncEventSourceClient *client) {
+    // the current reading straight away rather than on the next one, and a 5s reconnect
+    if (readingCount > 0 && client->lastId() != readingCount) {
+      client->send(livePacket, "reading", readingCount, 5000);
+    }
+  });
+  server.addHandler(&events);
+
   server.on("/api", HTTP_GET, [](AsyncWebServerRequest *request) {
-    AsyncResponseStream *response = request->beginResponseStream("application/json");
-    DynamicJsonDocument json(128);
-    json["heap"] = ESP.getFreeHeap();
-    json["co2"] = lastCo2;
-    json["temp"] = lastTemp;
-    json["humidity"] = lastHumidity;
-    serializeJson(json, *response);
+    timeRoute(request, "/api");
+    sendLive(request, "application/json", liveApi);
+  });
+
+  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    timeRoute(request, "/stats");
+    char stats[STATS_JSON_MAX];
+    formatStats(stats, sizeof(stats));
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", stats);
     response->addHeader("Cache-Control", "no-cache");
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
   });
 
   server.on("/table", HTTP_GET, [](AsyncWebServerRequest *request) {
-    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-      return getJSONChunk((char *)buffer, (int)maxLen, index);
+    timeRoute(request, "/table");
+    // a page for DataTables' server-side processing: no ETag, every answer has its own draw number
+    if (request->hasParam("draw")) {
+      uint32_t draw = strtoul(request->getParam("draw")->value().c_str(), NULL, 10);
+      uint32_t start = request->hasParam("start") ? strtoul(request->getParam("start")->value().c_str(), NULL, 10) : 0;
+      int32_t length = request->hasParam("length") ? strtol(request->getParam("length")->value().c_str(), NULL, 10) : 10;
+      uint8_t column = request->hasParam("order[0][column]") ? strtoul(request->getParam("order[0][column]")->value().c_str(), NULL, 10) : 0;
+      bool descending = request->hasParam("order[0][dir]") && request->getParam("order[0][dir]")->value() == "desc";
+      if (column >= 1 && column <= 3 && length < 0) { // sorted by a reading, every row is a pass over the ring
+        request->send(400, "text/plain", "length=-1 (every row) is only for time order");
+        return;
+      }
+      TableCursor cursor = beginPage(draw, start, length, column, descending);
+      AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+        return getJSONChunk((char *)buffer, (int)maxLen, index, cursor);
+      });
+      response->addHeader("Cache-Control", "no-store");
+      response->addHeader("Access-Control-Allow-Origin", "*");
+      request->send(response);
+      return;
+    }
+    // nothing new since the browser last asked: tell it to use what it has
+    char etag[24];
+    tableETag(etag, sizeof(etag));
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag) {
+      AsyncWebServerResponse *response = request->beginResponse(304);
+      response->addHeader("ETag", etag);
+      response->addHeader("Cache-Control", "no-cache");
+      response->addHeader("Access-Control-Allow-Origin", "*");
+      request->send(response);
+      return;
+    }
+
+    TableSource source = TABLE_RAW;
+    if (request->hasParam("res")) {
+      source = parseResolution(request->getParam("res")->value().c_str());
+    }
+    // a time range is served from the flash log, which goes back further than RAM
+    time_t from = 0, to = LONG_MAX;
+    if (request->hasParam("from")) from = strtoul(request->getParam("from")->value().c_str(), NULL, 10);
+    if (request->hasParam("to")) to = strtoul(request->getParam("to")->value().c_str(), NULL, 10);
+    if (source == TABLE_RAW && (request->hasParam("from") || request->hasParam("to"))) {
+      source = TABLE_LOG;
+    }
+    // just the rows newer than the ones the client already has
+    if (request->hasParam("since")) from = strtoul(request->getParam("since")->value().c_str(), NULL, 10) + 1;
+    // thinned for a chart: at most this many rows, whatever the range
+    uint16_t points = 0;
+    if (request->hasParam("points")) points = constrain(strtoul(request->getParam("points")->value().c_str(), NULL, 10), 0, 65535);
+    if (points > 0 && points < 3) { // LTTB always keeps the first and last rows and one between
+      request->send(400, "text/plain", "points must be 0 (all) or at least 3");
+      return;
+    }
+    TableCursor cursor = beginTable(source, from, to, TABLE_JSON, points);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+      return getJSONChunk((char *)buffer, (int)maxLen, index, cursor);
     });
-    response->addHeader("Cache-Control", "max-age=60, must-revalidate");
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache"); // always revalidate, it's only a 304 if nothing changed
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
   });
 
-  server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request) {
-    AsyncResponseStream *response = request->beginResponseStream("application/json");
-    DynamicJsonDocument json(512);
-    json["data"][0][0] = "WIFI_SSID";
-    json["data"][0][1] = WIFI_SSID;
-
-    json["data"][1][0] = "WIFI_PW";
-    json["data"][1][1] = "********";
-
-    json["data"][2][0] = "TIMEZONE";
-    json["data"][2][1] = TIMEZONE;
-
-    json["data"][3][0] = "DEBUG";
-    json["data"][3][1] = DEBUG;
-
-    json["data"][4][0] = "FAKE_SENSOR";
-    json["data"][4][1] = FAKE_SENSOR;
-
-    json["data"][5][0] = "ALTITUDE_ABOVE_SEA";
-    json["data"][5][1] = ALTITUDE_ABOVE_SEA;
-
-    json["data"][6][0] = "PPM_YELLOW";
-    json["data"][6][1] = PPM_YELLOW;
-
-    json["data"][7][0] = "PPM_ORANGE";
-    json["data"][7][1] = PPM_ORANGE;
-
-    json["data"][8][0] = "PPM_RED";
-    json["data"][8][1] = PPM_RED;
+  server.on("/export.csv", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendExport(request, false);
+  });
 
-    json["data"][9][0] = "LED_ALARM";
-    json["data"][9][1] = LED_ALARM;
+  server.on("/export.csv.gz", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendExport(request, true);
+  });
 
-    serializeJson(json, *response);
+  server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request) {
+    timeRoute(request, "/settings");
+    AsyncWebServerResponse *response = request->beginResponse_P(200, "application/json", (const uint8_t *)SETTINGS_JSON, sizeof(SETTINGS_JSON) - 1);
     response->addHeader("Cache-Control", "no-cache");
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
@@ -392,6 +799,7 @@ void setup(void) {
   });
 
   server.on("/admin", HTTP_POST, [](AsyncWebServerRequest *request) {
+    timeRoute(request, "/admin");
     if (request->hasParam("PPM", true)) {
       uint16_t ppmCalibrate = request->getParam("PPM", true)->value().toInt();
       Serial.printf("Calibrating with Co2 PPM: %i\n", ppmCalibrate);
@@ -405,111 +813,54 @@ void setup(void) {
     request->redirect("/admin.html?msg=invalid");
   });
 
-  server.onNotFound([](AsyncWebServerRequest *request) {
-    request->send(404, "text/plain", "Not found");
+#if TRACE_RECORD
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+    traceWriter.flush(); // so the download has everything up to now
+    request->send(SPIFFS, TRACE_FILE, "application/octet-stream", true);
   });
 
-  // start HTTP server
-  server.begin();
-
-  // set timezone & configure NTP
-  if (ENABLE_WIFI) {
-    configTime(0, 0, NTP_SERVER);
-    setTimezone(TIMEZONE);
-    Serial.printf("Timezone set to: %s\n", TIMEZONE);
-  }
-
-  // start SCD30 sensor (it likes being last...)
-  Wire.begin(SCD30_SDA, SCD30_SCL);
-  if (!airSensor.begin()) {
-    Serial.println("SCD30 not detected. Please check wiring. Freezing...");
-    while (1);
-  }
-
-  airSensor.setAltitudeCompensation(ALTITUDE_ABOVE_SEA); // tell SCD30 our altitude
-
-  // print various sensor information
-  Serial.print("Auto calibration set to: ");
-  if (airSensor.getAutoSelfCalibration() == true) {
-    Serial.println("true");
-  } else {
-    Serial.println("false");
-  }
-
-  int interval = airSensor.getMeasurementInterval();
-  Serial.print("Measurement Interval: "); Serial.println(interval);
-
-  unsigned int altitude = airSensor.getAltitudeCompensation();
-  Serial.print("Current altitude: "); Serial.print(altitude); Serial.println("m");
-
-  float offset = airSensor.getTemperatureOffset();
-  Serial.print("Current temp offset: "); Serial.print(offset, 2); Serial.println(" C");
-}
-
-unsigned long timeRun = 0L; // for graph timer
-#if !FAKE_SENSOR
-unsigned long MinuteCounter = (60*1000L); // for graph timer
-#else
-unsigned long MinuteCounter = (5*1000L); // Also make time go faster
+  server.on("/trace", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+    request->send(traceWriter.clear() ? 204 : 500);
+  });
 #endif
-bool firstRead = true;
-char co2StringBuffer[14];
 
-void loop() {
-  unsigned long currentMillis = millis();
-  updateReadings(); // check if, and update when, new sensor values are available
-
-  tft.loadFont(AA_FONT_LARGE); // Must load the font first
-  tft.setTextDatum(TC_DATUM); // Top centre
-  tft.setTextPadding(100);
-  if (lastCo2 >= PPM_RED) {
-    tft.setTextColor(TFT_RED, TFT_BLACK);
-  }  else if (lastCo2 >= PPM_ORANGE) {
-    tft.setTextColor(TFT_ORANGE, TFT_BLACK);
-  } else if (lastCo2 >= PPM_YELLOW) {
-    tft.setTextColor(TFT_YELLOW, TFT_BLACK);
-  } else {
-    tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  }
-  // convert uint into string with "," on >=1000
-  tft.drawString(ultoa(lastCo2, co2StringBuffer), 65, 4); // x-axis: 65 (half of 130px), y-axis: 4 (any lower and the text padding crops the top of the "2k")
-  tft.unloadFont();
-
-  if (firstRead) { // to get the first graph/table plot without having to wait a minute
-    updGraph(lastCo2);
-    updTable(lastCo2, lastTemp, lastHumidity);
-    firstRead = false;
-  }
+  server.on("/tasks", HTTP_GET, [](AsyncWebServerRequest *request) {
+    timeRoute(request, "/tasks");
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    scheduler.printStats(*response);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+  });
 
-  tft.loadFont(AA_FONT_SMALL); // Must load the font first
-  tft.setTextColor(TFT_WHITE, TFT_BLACK); // Set the font colour AND the background colour so the anti-aliasing works
-  tft.setTextDatum(TL_DATUM); // Top left
-  tft.setTextPadding(20);
-  // Temp
-  tft.drawFloat(lastTemp, 1, 22, 112); tft.print(" °C");
-  // Humidity
-  tft.drawFloat(lastHumidity, 0, 92, 112);
-  tft.unloadFont();
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    timeRoute(request, "/metrics");
+    MetricsCursor cursor = {};
+    AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain; version=0.0.4", [cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+      return getMetricsChunk((char *)buffer, (int)maxLen, cursor);
+    });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+  });
 
-  // for serial plotter
-  //Serial.println(lastCo2);
+  server.onNotFound([](AsyncWebServerRequest *request) {
+    request->send(404, "text/plain", "Not found");
+  });
 
-  if (currentMillis - timeRun >= MinuteCounter) { // update graph & table every 1 min
-    timeRun += MinuteCounter;
-    updGraph(lastCo2);
-    updTable(lastCo2, lastTemp, lastHumidity);
-    // tftSleep();
-  }
+  // Order matters on the first pass: read the sensor before anything uses the reading
+  scheduler.add("sensor", 1000, updateReadings); // the SCD30 spits the dummy if it's polled much faster
+  scheduler.add("history", MinuteCounter, updHistory, 4000); // update graph & table every 1 min, starting once the SCD30 has a reading (every 2s)
+  scheduler.add("display", 250, updDisplay);
+  scheduler.add("led", 10, updLed); // JLed needs frequent updates to breathe smoothly
+  scheduler.add("network", 50, updNetwork);
+  renderApi(); // /api has something to say before the first reading
 
-  if (lastCo2 >= LED_ALARM) { // determine whether LED should be on/off
-    if (!ledAlarm.IsRunning()) {
-      ledAlarm.Reset();
-    }
-    ledAlarm.Update();
-  } else {
-    ledAlarm.Stop();
+  // Wi-Fi, mDNS, NTP and the web server come up in the background (the network task)
+  if (ENABLE_WIFI) {
+    wifiLink.begin(WIFI_SSID, WIFI_PW, startNetworkServices);
   }
+}
 
-  if (ENABLE_WIFI) { MDNS.update(); }
-  delay(1000); // this is needed or SCD30 spits the dummy
+void loop() {
+  scheduler.run();
+  metrics.loopPass(scheduler.lastPassUs);
 }
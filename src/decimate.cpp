@@ -0,0 +1,50 @@
+#include "decimate.h"
+
+void Lttb::begin(uint32_t first, uint32_t end, uint16_t points) {
+  _first = first;
+  _rows = end - first;
+  _points = points < 3 ? 3 : points;
+  _bucket = 0;
+  _aimX = _aimY = 0;
+  _aimCount = 0;
+  _best = -1;
+}
+
+// The first and last buckets are the first and last rows, the others share the rows between
+uint32_t Lttb::bucketEnd(uint16_t b) const {
+  if (b + 1 >= _points) {
+    return _first + _rows;
+  }
+  return _first + 1 + (uint32_t)((uint64_t)b * (_rows - 2) / (_points - 2));
+}
+
+void Lttb::aim(int32_t x, int32_t y) {
+  _aimX += (int64_t)x - _x;
+  _aimY += (int64_t)y - _y;
+  _aimCount++;
+}
+
+bool Lttb::consider(int32_t x, int32_t y) {
+  int64_t area = 0;
+  if (_aimCount) {
+    // with the kept row at the origin, twice the area is the cross product
+    int64_t ax = _aimX / (int32_t)_aimCount;
+    int64_t ay = _aimY / (int32_t)_aimCount;
+    area = ((int64_t)x - _x) * ay - ((int64_t)y - _y) * ax;
+    if (area < 0) area = -area;
+  }
+  if (area <= _best) {
+    return false;
+  }
+  _best = area;
+  return true;
+}
+
+void Lttb::next(int32_t x, int32_t y) {
+  _x = x;
+  _y = y;
+  _aimX = _aimY = 0;
+  _aimCount = 0;
+  _best = -1;
+  _bucket++;
+}
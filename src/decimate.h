@@ -0,0 +1,48 @@
+/*
+
+Thinning a series down to a few points for a chart, with Largest-Triangle-
+Three-Buckets: the first and last points are kept, the rest are split into
+equal buckets, and from each bucket the point kept is the one making the
+largest triangle with the point kept from the bucket before and the mean of
+the bucket after. Peaks and dips survive, flat runs don't take up points.
+
+It works on numbered rows (history samples, log records) and doesn't hold
+any of them: the caller walks each bucket twice, first as the bucket after
+the one being picked from (aim()), then as the one being picked from
+(consider()), so it can stream from two cursors a bucket apart. Behind
+/table?points=N and the TFT graph when it shows more history than it has
+columns.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+class Lttb {
+public:
+  // Thin rows first..end-1 down to points; fewer than 3 is taken as 3
+  void begin(uint32_t first, uint32_t end, uint16_t points);
+  uint16_t points() const { return _points; }
+  // The bucket to pick from next; points() once they're all done
+  uint16_t bucket() const { return _bucket; }
+  // Rows bucketStart(b)..bucketEnd(b)-1 make up bucket b
+  uint32_t bucketStart(uint16_t b) const { return b == 0 ? _first : bucketEnd(b - 1); }
+  uint32_t bucketEnd(uint16_t b) const;
+
+  // A row of the bucket after bucket()
+  void aim(int32_t x, int32_t y);
+  // A row of bucket(); true if it's the best of the bucket so far
+  bool consider(int32_t x, int32_t y);
+  // Done with bucket(), having kept row x, y (its best, if it had any): on to the next
+  void next(int32_t x, int32_t y);
+
+private:
+  uint32_t _first = 0;
+  uint32_t _rows = 0;
+  uint16_t _points = 0;
+  uint16_t _bucket = 0;
+  int32_t _x = 0, _y = 0;   // the row kept from the bucket before
+  int64_t _aimX = 0, _aimY = 0; // sums of the aim() rows, relative to it
+  uint32_t _aimCount = 0;
+  int64_t _best = -1;       // twice the largest area so far
+};
@@ -0,0 +1,309 @@
+#define FS_NO_GLOBALS
+#include <FS.h>
+#include <algorithm>
+#include <limits.h>
+#include "flashlog.h"
+
+// settings.h for DEBUG
+#include "settings.h"
+
+#define LOG_MAGIC 0xC2
+
+FlashLog flashLog;
+
+static uint8_t crc8(const uint8_t *data, uint8_t len) {
+  uint8_t crc = 0xFF;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+static bool valid(const LogRecord &r) {
+  return r.magic == LOG_MAGIC && r.crc == crc8((const uint8_t *)&r, sizeof(LogRecord) - 1);
+}
+
+static void toSample(const LogRecord &r, Sample &out) {
+  out.time = r.time;
+  out.co2 = r.co2;
+  out.temp = r.temp;
+  out.humidity = r.humidity;
+}
+
+static String segmentName(uint32_t first) {
+  char name[20];
+  snprintf(name, sizeof(name), LOG_DIR "%08lx", (unsigned long)first);
+  return String(name);
+}
+
+bool FlashLog::begin() {
+  fs::Dir dir = SPIFFS.openDir(LOG_DIR);
+  while (dir.next()) {
+    String name = dir.fileName();
+    uint32_t first = strtoul(name.c_str() + name.lastIndexOf('/') + 1, NULL, 16);
+    if (_segmentCount == LOG_MAX_SEGMENTS) { // more than we keep (setting was lowered?)
+      uint8_t oldest = 0;
+      for (uint8_t i = 1; i < _segmentCount; i++) {
+        if (_segments[i] < _segments[oldest]) oldest = i;
+      }
+      if (first < _segments[oldest]) {
+        SPIFFS.remove(name);
+        continue;
+      }
+      SPIFFS.remove(segmentName(_segments[oldest]));
+      _segments[oldest] = first;
+    } else {
+      _segments[_segmentCount++] = first;
+    }
+  }
+  std::sort(_segments, _segments + _segmentCount);
+
+  if (_segmentCount == 0) {
+    return true;
+  }
+
+  // Find where the newest segment really ends: drop a torn record and any
+  // garbage the last (interrupted) write left behind
+  uint32_t last = _segments[_segmentCount - 1];
+  fs::File f = SPIFFS.open(segmentName(last), "r+");
+  if (!f) {
+    return false;
+  }
+  size_t size = f.size();
+  uint32_t records = size / sizeof(LogRecord);
+  LogRecord r;
+  while (records > 0) {
+    f.seek((records - 1) * sizeof(LogRecord));
+    if (f.read((uint8_t *)&r, sizeof(r)) == sizeof(r) && valid(r)) {
+      break;
+    }
+    records--;
+  }
+  if (records * sizeof(LogRecord) != size) {
+    Serial.printf("Log segment %08lx has a torn tail, keeping %lu records\n", (unsigned long)last, (unsigned long)records);
+    if (!f.truncate(records * sizeof(LogRecord))) {
+      _rotate = true; // leave the garbage where it is, readers stop before it
+    }
+  }
+  f.close();
+  _end = last + records;
+  if (records == 0) { // nothing worth keeping; the next segment will reuse its name
+    SPIFFS.remove(segmentName(last));
+    _segmentCount--;
+    _rotate = false;
+  }
+
+  for (uint8_t i = 0; i < _segmentCount; i++) {
+    _segmentTimes[i] = readRecords(_segments[i], &r, 1) ? r.time : 0;
+  }
+  if (DEBUG) { Serial.printf("Flash log: %u segments, records %lu-%lu\n", _segmentCount, (unsigned long)first(), (unsigned long)_end); }
+  return true;
+}
+
+void FlashLog::append(time_t time, uint16_t co2, int16_t temp, uint16_t humidity) {
+  LogRecord &r = _batch[_pending++];
+  r.time = time;
+  r.co2 = co2;
+  r.temp = temp;
+  r.humidity = humidity;
+  r.magic = LOG_MAGIC;
+  r.crc = crc8((const uint8_t *)&r, sizeof(LogRecord) - 1);
+  if (_pending == LOG_BATCH) {
+    flush();
+  }
+}
+
+void FlashLog::startSegment() {
+  if (_segmentCount == LOG_MAX_SEGMENTS) {
+    SPIFFS.remove(segmentName(_segments[0]));
+    memmove(_segments, _segments + 1, (LOG_MAX_SEGMENTS - 1) * sizeof(_segments[0]));
+    memmove(_segmentTimes, _segmentTimes + 1, (LOG_MAX_SEGMENTS - 1) * sizeof(_segmentTimes[0]));
+    _segmentCount--;
+  }
+  _segments[_segmentCount] = _end;
+  _segmentTimes[_segmentCount] = _batch[0].time;
+  _segmentCount++;
+  _rotate = false;
+}
+
+void FlashLog::flush() {
+  uint8_t done = 0;
+  while (done < _pending) {
+    if (_segmentCount == 0 || _rotate || _end - _segments[_segmentCount - 1] >= LOG_SEGMENT_RECORDS) {
+      memmove(_batch, _batch + done, (_pending - done) * sizeof(LogRecord));
+      _pending -= done;
+      done = 0;
+      startSegment();
+    }
+    uint32_t room = LOG_SEGMENT_RECORDS - (_end - _segments[_segmentCount - 1]);
+    uint8_t n = (uint32_t)(_pending - done) < room ? _pending - done : room;
+
+    fs::File f = SPIFFS.open(segmentName(_segments[_segmentCount - 1]), "a");
+    size_t written = f ? f.write((const uint8_t *)(_batch + done), n * sizeof(LogRecord)) : 0;
+    f.close();
+    if (written != n * sizeof(LogRecord)) { // filesystem full or failing; drop the batch rather than wedge
+      Serial.println("Flash log write failed!");
+      writeErrors++;
+      _end += written / sizeof(LogRecord);
+      _rotate = true;
+      break;
+    }
+    _end += n;
+    done += n;
+  }
+  _pending = 0;
+}
+
+int8_t FlashLog::segmentFor(uint32_t n) const {
+  for (int8_t i = _segmentCount - 1; i >= 0; i--) {
+    if (n >= _segments[i]) return i;
+  }
+  return -1;
+}
+
+// Read up to max consecutive records starting at n, from one segment or the batch
+uint8_t FlashLog::readRecords(uint32_t n, LogRecord *out, uint8_t max) const {
+  if (n >= _end) { // not on flash yet
+    uint32_t i = n - _end;
+    uint8_t count = 0;
+    while (count < max && i < _pending) {
+      out[count++] = _batch[i++];
+    }
+    return count;
+  }
+  int8_t seg = segmentFor(n);
+  if (seg < 0) {
+    return 0;
+  }
+  uint32_t segEnd = (seg + 1 < _segmentCount) ? _segments[seg + 1] : _end;
+  if (segEnd - n < max) {
+    max = segEnd - n;
+  }
+  fs::File f = SPIFFS.open(segmentName(_segments[seg]), "r");
+  if (!f || !f.seek((n - _segments[seg]) * sizeof(LogRecord))) {
+    return 0;
+  }
+  uint8_t count = f.read((uint8_t *)out, max * sizeof(LogRecord)) / sizeof(LogRecord);
+  f.close();
+  return count;
+}
+
+time_t FlashLog::timeAt(uint32_t n) const {
+  LogRecord r;
+  return readRecords(n, &r, 1) ? r.time : 0;
+}
+
+LogCursor FlashLog::seek(time_t from, time_t to) const {
+  LogCursor cursor = {};
+  cursor.n = first();
+  cursor.to = to;
+
+  // the segment that holds "from", then a binary search inside it
+  int8_t seg = -1;
+  for (int8_t i = _segmentCount - 1; i >= 0; i--) {
+    if (_segmentTimes[i] <= from) {
+      seg = i;
+      break;
+    }
+  }
+  if (seg < 0) {
+    return cursor;
+  }
+  uint32_t lo = _segments[seg];
+  uint32_t hi = (seg + 1 < _segmentCount) ? _segments[seg + 1] : _end;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (timeAt(mid) < from) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  cursor.n = lo;
+  return cursor;
+}
+
+uint32_t FlashLog::after(time_t time) const {
+  if (time >= LONG_MAX) {
+    return end();
+  }
+  uint32_t n = seek(time + 1, LONG_MAX).n;
+  if (n == _end) { // seek() only searches flash; the batch not written yet comes after
+    while (n < end() && (time_t)_batch[n - _end].time <= time) n++;
+  }
+  return n;
+}
+
+bool FlashLog::fill(LogCursor &cursor) const {
+  cursor.pos = 0;
+  cursor.count = readRecords(cursor.n, cursor.buf, sizeof(cursor.buf) / sizeof(cursor.buf[0]));
+  return cursor.count > 0;
+}
+
+bool FlashLog::read(LogCursor &cursor, Sample &out) const {
+  while (true) {
+    if (cursor.n < first()) { // its segment was deleted under us
+      cursor.n = first();
+      cursor.count = cursor.pos = 0;
+    }
+    if (cursor.pos == cursor.count && !fill(cursor)) {
+      // the middle of a segment can only be unreadable if flash is failing; step over it
+      if (cursor.n >= end()) {
+        return false;
+      }
+      cursor.n++;
+      continue;
+    }
+    const LogRecord &r = cursor.buf[cursor.pos++];
+    cursor.n++;
+    if (!valid(r)) {
+      continue;
+    }
+    if ((time_t)r.time > cursor.to) {
+      cursor.n = end(); // past the range; stay finished
+      cursor.count = cursor.pos = 0;
+      return false;
+    }
+    toSample(r, out);
+    return true;
+  }
+}
+
+// read() opens the segment for every few records, which is fine for a page
+// of /table but would be over a thousand opens for the whole log at boot
+uint32_t FlashLog::replay(void (*each)(const Sample &sample)) const {
+  uint32_t count = 0;
+  LogRecord buf[8];
+  Sample sample;
+  for (uint8_t seg = 0; seg < _segmentCount; seg++) {
+    fs::File f = SPIFFS.open(segmentName(_segments[seg]), "r");
+    if (!f) {
+      continue;
+    }
+    uint32_t left = ((seg + 1 < _segmentCount) ? _segments[seg + 1] : _end) - _segments[seg];
+    while (left) {
+      uint8_t n = f.read((uint8_t *)buf, std::min<uint32_t>(left, 8) * sizeof(LogRecord)) / sizeof(LogRecord);
+      if (n == 0) {
+        break;
+      }
+      left -= n;
+      for (uint8_t i = 0; i < n; i++) {
+        if (valid(buf[i])) {
+          toSample(buf[i], sample);
+          each(sample);
+          count++;
+        }
+      }
+    }
+    f.close();
+  }
+  for (uint8_t i = 0; i < _pending; i++) {
+    toSample(_batch[i], sample);
+    each(sample);
+    count++;
+  }
+  return count;
+}
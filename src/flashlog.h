@@ -0,0 +1,87 @@
+/*
+
+Append-only measurement log on the SPIFFS partition, so history survives a
+reboot or a power blip.
+
+Records are 12 bytes with a magic byte and a CRC. They are held in RAM and
+written LOG_BATCH at a time (just under one 256 byte SPIFFS page) to keep
+flash wear down. The log is split into segment files named after the number
+of their first record ("/log/0000a8c0"). When there are LOG_MAX_SEGMENTS
+the oldest is deleted, which caps the log at about 128 KB (7.5 days).
+
+Every record has a number that never changes, so a reader just keeps the
+number of the next record it wants. A torn or corrupt tail (power lost
+mid-write) is cut off in begin(), and readers skip any record that fails
+its CRC.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include "history.h"
+
+#define LOG_DIR "/log/"
+#define LOG_SEGMENT_RECORDS 1365 // 16 KB segment files
+#define LOG_MAX_SEGMENTS 8
+#define LOG_BATCH 20 // records per flash write
+
+struct LogRecord {
+  uint32_t time;
+  uint16_t co2;
+  int16_t temp;
+  uint16_t humidity;
+  uint8_t magic;
+  uint8_t crc;
+};
+
+// A reading position in the log. Like HistoryCursor, it stays valid while
+// records are appended or old segments are deleted underneath it.
+struct LogCursor {
+  uint32_t n;  // number of the next record to read
+  time_t to;   // last time to return
+  uint8_t count;
+  uint8_t pos;
+  LogRecord buf[8]; // records n - pos .. n - pos + count, read ahead from flash
+};
+
+class FlashLog {
+public:
+  // Find the segments and repair a torn tail. Call after SPIFFS.begin().
+  bool begin();
+  // Queue a record; it reaches flash when the batch fills up
+  void append(time_t time, uint16_t co2, int16_t temp, uint16_t humidity);
+  void flush();
+
+  // Number of the next record to be appended, i.e. records ever written
+  uint32_t end() const { return _end + _pending; }
+  uint32_t first() const { return _segmentCount ? _segments[0] : _end; }
+
+  // Cursor at the first record at or after "from", reading up to "to"
+  LogCursor seek(time_t from, time_t to) const;
+  // Number of the first record later than time (end() if there's none)
+  uint32_t after(time_t time) const;
+  // Read the next record into out; false at the end of the range
+  bool read(LogCursor &cursor, Sample &out) const;
+  // Every record, oldest first, through one open file per segment; returns how many
+  uint32_t replay(void (*each)(const Sample &sample)) const;
+
+  uint32_t writeErrors = 0;
+
+private:
+  bool fill(LogCursor &cursor) const;
+  uint8_t readRecords(uint32_t n, LogRecord *out, uint8_t max) const;
+  time_t timeAt(uint32_t n) const;
+  int8_t segmentFor(uint32_t n) const;
+  void startSegment();
+
+  uint32_t _segments[LOG_MAX_SEGMENTS];   // number of each segment's first record, oldest first
+  time_t _segmentTimes[LOG_MAX_SEGMENTS]; // time of each segment's first record
+  uint8_t _segmentCount = 0;
+  uint32_t _end = 0; // records on flash
+  bool _rotate = false; // start a new segment on the next write
+
+  LogRecord _batch[LOG_BATCH];
+  uint8_t _pending = 0;
+};
+
+extern FlashLog flashLog;
@@ -0,0 +1,117 @@
+#include "forecast.h"
+
+#define FORECAST_WINDOW (FORECAST_POINTS * FORECAST_STEP)
+#define FORECAST_HORIZON 86400 // further off than a day is as good as never
+
+void TrendForecast::add(uint32_t now, uint16_t co2) {
+  uint32_t stepStart = now - now % FORECAST_STEP;
+  if (_stepCount > 0 && stepStart != _stepStart) {
+    push(_stepStart + FORECAST_STEP / 2, (_stepSum + _stepCount / 2) / _stepCount);
+    _stepSum = 0;
+    _stepCount = 0;
+  }
+  _stepStart = stepStart;
+  _stepSum += co2;
+  _stepCount++;
+}
+
+void TrendForecast::push(uint32_t time, uint16_t co2) {
+  while (_count > 0 && time - _points[_head].time >= FORECAST_WINDOW) { // slid out (or a gap in the readings)
+    drop();
+  }
+  if (_count == FORECAST_POINTS) {
+    drop();
+  }
+  if (_count == 0) {
+    _origin = time;
+    _sumT = _sumY = _sumTT = _sumTY = 0;
+  } else if (time - _origin > 4 * FORECAST_WINDOW) {
+    rebase(_points[_head].time);
+  }
+
+  _points[(_head + _count) % FORECAST_POINTS] = { time, co2 };
+  _count++;
+  int64_t t = time - _origin;
+  _sumT += t;
+  _sumY += co2;
+  _sumTT += t * t;
+  _sumTY += t * co2;
+}
+
+void TrendForecast::drop() {
+  const Point &p = _points[_head];
+  int64_t t = p.time - _origin;
+  _sumT -= t;
+  _sumY -= p.co2;
+  _sumTT -= t * t;
+  _sumTY -= t * p.co2;
+  _head = (_head + 1) % FORECAST_POINTS;
+  _count--;
+}
+
+// Count time from origin instead: (t - d)² and (t - d)·y expanded over the sums
+void TrendForecast::rebase(uint32_t origin) {
+  int64_t d = origin - _origin;
+  _sumTT += -2 * d * _sumT + _count * d * d;
+  _sumTY -= d * _sumY;
+  _sumT -= _count * d;
+  _origin = origin;
+}
+
+// The fit's slope is num/den ppm per second, with
+//   num = n·Σty - Σt·Σy,  den = n·Σtt - (Σt)²
+int32_t TrendForecast::slope() const {
+  if (!ready()) {
+    return 0;
+  }
+  int64_t den = _count * _sumTT - _sumT * _sumT;
+  if (den <= 0) {
+    return 0;
+  }
+  int64_t num = (_count * _sumTY - _sumT * _sumY) * 600; // ppm/s -> tenths of a ppm/min
+  return (num + (num < 0 ? -den : den) / 2) / den;
+}
+
+int32_t TrendForecast::secondsTo(uint16_t threshold, uint32_t now) const {
+  if (!ready()) {
+    return -1;
+  }
+  int64_t den = _count * _sumTT - _sumT * _sumT;
+  if (den <= 0) {
+    return -1;
+  }
+  int64_t num = _count * _sumTY - _sumT * _sumY;
+  // the line is at y(t) = (Σy·den + num·(n·t - Σt)) / (n·den); how far is it below threshold now?
+  int64_t t = now - _origin;
+  int64_t below = threshold * _count * den - (_sumY * den + num * (_count * t - _sumT));
+  if (below <= 0) {
+    return 0;
+  }
+  if (num <= 0) {
+    return -1;
+  }
+  int64_t eta = below / (_count * num);
+  return eta > FORECAST_HORIZON ? -1 : (int32_t)eta;
+}
+
+AlarmLevel Alarm::update(uint16_t co2, int32_t eta) {
+  if (_level == ALARM_ON ? co2 + _hysteresis >= threshold : co2 >= threshold) {
+    _level = ALARM_ON;
+    return _level;
+  }
+  // a warning starts at the lead time, and lasts until the crossing is twice that far off
+  uint32_t lead = _level == ALARM_SOON ? 2 * _lead : _lead;
+  _level = eta >= 0 && (uint32_t)eta <= lead ? ALARM_SOON : ALARM_CLEAR;
+  return _level;
+}
+
+const char *Alarm::name() const {
+  switch (_level) {
+  case ALARM_SOON:
+    return "soon";
+  case ALARM_ON:
+    return "on";
+  default:
+    return "clear";
+  }
+}
@@ -0,0 +1,86 @@
+/*
+
+Where the CO2 is heading: a least-squares line through the last 10 minutes
+of readings, and how long until it crosses a threshold. The alarm works off
+that, so it can go off minutes before the room gets bad rather than after,
+and has hysteresis so it doesn't flap on readings that wobble around the
+threshold.
+
+Readings are averaged into FORECAST_STEP second points (which also takes
+out most of the SCD30's noise). The fit keeps running sums of t, y, t² and
+ty over the points in the window, adding a point as it arrives and
+subtracting the one that drops out, so an update is O(1) and no float is
+involved. Time is counted from an origin that moves up behind the window,
+which keeps the sums small enough to be exact in 64 bits.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define FORECAST_STEP 10       // seconds per point
+#define FORECAST_POINTS 60     // points in the window: 10 minutes
+#define FORECAST_MIN_POINTS 12 // no forecast from less than 2 minutes
+
+class TrendForecast {
+public:
+  // A reading taken at now (statsUptime() seconds)
+  void add(uint32_t now, uint16_t co2);
+  bool ready() const { return _count >= FORECAST_MIN_POINTS; }
+  // Slope of the trend in tenths of a ppm per minute (0 until ready)
+  int32_t slope() const;
+  // Seconds from now until the trend line reaches threshold: 0 if it already
+  // has, -1 if it never will (flat or falling) or there's no forecast yet
+  int32_t secondsTo(uint16_t threshold, uint32_t now) const;
+
+private:
+  struct Point {
+    uint32_t time;
+    uint16_t co2;
+  };
+
+  void push(uint32_t time, uint16_t co2);
+  void drop();
+  void rebase(uint32_t origin);
+
+  Point _points[FORECAST_POINTS];
+  uint8_t _head = 0; // oldest point
+  uint8_t _count = 0;
+
+  uint32_t _origin = 0; // time the sums count from
+  int64_t _sumT = 0;
+  int64_t _sumY = 0;
+  int64_t _sumTT = 0;
+  int64_t _sumTY = 0;
+
+  // the point being averaged
+  uint32_t _stepStart = 0;
+  uint32_t _stepSum = 0;
+  uint8_t _stepCount = 0;
+};
+
+enum AlarmLevel {
+  ALARM_CLEAR,
+  ALARM_SOON, // the trend crosses the threshold within the lead time
+  ALARM_ON,
+};
+
+class Alarm {
+public:
+  // On at threshold, off again below threshold - hysteresis. Warns when the
+  // forecast crossing is leadSeconds away, and stops warning once it's twice that.
+  Alarm(uint16_t threshold, uint16_t hysteresis, uint32_t leadSeconds)
+    : threshold(threshold), _hysteresis(hysteresis), _lead(leadSeconds) {}
+
+  // eta from TrendForecast::secondsTo(threshold)
+  AlarmLevel update(uint16_t co2, int32_t eta);
+  AlarmLevel level() const { return _level; }
+  const char *name() const;
+
+  const uint16_t threshold;
+
+private:
+  uint16_t _hysteresis;
+  uint32_t _lead;
+  AlarmLevel _level = ALARM_CLEAR;
+};
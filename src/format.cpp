@@ -0,0 +1,83 @@
+#include "format.h"
+
+// Two digits at a time halves the divisions, which are a library call on the ESP8266
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+char *appendUnsigned(char *out, uint32_t v) {
+  char digits[FORMAT_UNSIGNED_MAX];
+  char *p = digits + sizeof(digits);
+  while (v >= 100) {
+    uint32_t pair = v % 100;
+    v /= 100;
+    *--p = DIGIT_PAIRS[pair * 2 + 1];
+    *--p = DIGIT_PAIRS[pair * 2];
+  }
+  if (v >= 10) {
+    *--p = DIGIT_PAIRS[v * 2 + 1];
+    *--p = DIGIT_PAIRS[v * 2];
+  } else {
+    *--p = '0' + v;
+  }
+  size_t len = digits + sizeof(digits) - p;
+  memcpy(out, p, len);
+  return out + len;
+}
+
+char *appendCenti(char *out, int32_t centi, uint8_t decimals) {
+  uint32_t v = centi < 0 ? -(uint32_t)centi : centi;
+  if (decimals == 0) {
+    v = (v + 50) / 100;
+  } else if (decimals == 1) {
+    v = (v + 5) / 10;
+  }
+  if (centi < 0 && v != 0) { // no "-0.0"
+    *out++ = '-';
+  }
+
+  if (decimals == 0) {
+    return appendUnsigned(out, v);
+  }
+  uint32_t one = decimals == 1 ? 10 : 100;
+  out = appendUnsigned(out, v / one);
+  *out++ = '.';
+  uint32_t fraction = v % one;
+  if (decimals == 1) {
+    *out++ = '0' + fraction;
+  } else {
+    *out++ = DIGIT_PAIRS[fraction * 2];
+    *out++ = DIGIT_PAIRS[fraction * 2 + 1];
+  }
+  return out;
+}
+
+static char *appendPair(char *out, uint8_t v) {
+  *out++ = DIGIT_PAIRS[v * 2];
+  *out++ = DIGIT_PAIRS[v * 2 + 1];
+  return out;
+}
+
+char *appendDateTime(char *out, time_t t) {
+  struct tm local;
+  localtime_r(&t, &local);
+  out = appendUnsigned(out, local.tm_year + 1900);
+  *out++ = '-';
+  out = appendPair(out, local.tm_mon + 1);
+  *out++ = '-';
+  out = appendPair(out, local.tm_mday);
+  *out++ = ' ';
+  out = appendPair(out, local.tm_hour);
+  *out++ = ':';
+  out = appendPair(out, local.tm_min);
+  *out++ = ':';
+  return appendPair(out, local.tm_sec);
+}
@@ -0,0 +1,28 @@
+/*
+
+Integer-to-decimal formatting for the readings, so nothing between the
+sensor and the browser goes through float (soft-float on the ESP8266) or
+printf. Temperature and humidity are carried as hundredths everywhere, see
+history.h.
+
+The append functions write at out and return the new end, without a
+terminating '\0', so pieces can be strung together:
+  char *p = appendCenti(buf, 2150, 1); // "21.5"
+  *p = '\0';
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+#define FORMAT_UNSIGNED_MAX 10 // digits in a uint32_t
+#define FORMAT_CENTI_MAX 12    // "-21474836.48"
+#define FORMAT_DATETIME_MAX 19 // "2024-05-01 13:45:00"
+
+// v in decimal
+char *appendUnsigned(char *out, uint32_t v);
+// Hundredths as a decimal with 0, 1 or 2 places, rounded half away from zero
+char *appendCenti(char *out, int32_t centi, uint8_t decimals);
+// Local time (TIMEZONE) as "2024-05-01 13:45:00", which spreadsheets read as a date
+char *appendDateTime(char *out, time_t t);
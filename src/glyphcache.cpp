@@ -0,0 +1,226 @@
+#define FS_NO_GLOBALS
+#include <FS.h>
+#include "glyphcache.h"
+#include "spicount.h"
+
+// settings.h for DEBUG
+#include "settings.h"
+
+#define VLW_HEADER 24 // six 32 bit words
+#define VLW_METRICS 28 // seven 32 bit words a glyph
+#define GLYPH_MAX_WIDTH 64
+
+static uint32_t readInt32(fs::File &f) {
+  uint8_t b[4];
+  f.read(b, 4);
+  return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+// Next character of a UTF-8 string (only up to 3 byte sequences, which is plenty for "°")
+static uint16_t nextChar(const char *&s) {
+  uint8_t c = *s++;
+  if (c < 0x80) {
+    return c;
+  }
+  if ((c & 0xE0) == 0xC0 && *s) {
+    return ((c & 0x1F) << 6) | (*s++ & 0x3F);
+  }
+  if ((c & 0xF0) == 0xE0 && s[0] && s[1]) {
+    uint16_t u = ((c & 0x0F) << 12) | ((s[0] & 0x3F) << 6) | (s[1] & 0x3F);
+    s += 2;
+    return u;
+  }
+  return '?';
+}
+
+static bool wanted(const char *chars, uint16_t unicode) {
+  while (*chars) {
+    if (nextChar(chars) == unicode) return true;
+  }
+  return false;
+}
+
+bool GlyphCache::load(const char *path, const char *chars) {
+  fs::File f = SPIFFS.open(path, "r");
+  if (!f) {
+    return false;
+  }
+  uint32_t count = readInt32(f);
+  readInt32(f); // encoder version
+  readInt32(f); // size in points
+  readInt32(f);
+  uint8_t ascent = readInt32(f);
+  uint8_t descent = readInt32(f);
+  _spaceWidth = (ascent + descent) / 4;
+
+  // One pass over the metrics for the ones we keep and where their bitmaps are
+  uint32_t bitmapStart = VLW_HEADER + count * VLW_METRICS;
+  uint32_t fileOffsets[GLYPH_CACHE_MAX];
+  uint32_t fileOffset = bitmapStart;
+  uint16_t cacheSize = 0;
+  _count = 0;
+  _ascent = ascent;
+  _descent = descent;
+  for (uint32_t i = 0; i < count; i++) {
+    Glyph g;
+    g.unicode = readInt32(f);
+    g.height = readInt32(f);
+    g.width = readInt32(f);
+    g.xAdvance = readInt32(f);
+    g.dY = readInt32(f);
+    g.dX = readInt32(f);
+    readInt32(f); // padding
+
+    // like TFT_eSPI, size the line from the tallest glyphs rather than the header
+    if ((g.unicode > 0x20 && g.unicode < 0x7F) || g.unicode > 0xA0) {
+      if (g.dY > _ascent) _ascent = g.dY;
+      if (g.height - g.dY > _descent) _descent = g.height - g.dY;
+    }
+    if (_count < GLYPH_CACHE_MAX && g.width <= GLYPH_MAX_WIDTH && wanted(chars, g.unicode)) {
+      g.offset = cacheSize;
+      cacheSize += (g.width + 1) / 2 * g.height;
+      fileOffsets[_count] = fileOffset;
+      _glyphs[_count++] = g;
+    }
+    fileOffset += g.width * g.height;
+  }
+
+  free(_bitmaps);
+  _bitmaps = (uint8_t *)malloc(cacheSize);
+  if (!_bitmaps) {
+    _count = 0;
+    f.close();
+    return false;
+  }
+
+  // Then pack each kept bitmap down to 4 bits a pixel
+  uint8_t row[GLYPH_MAX_WIDTH + 1];
+  for (uint8_t i = 0; i < _count; i++) {
+    const Glyph &g = _glyphs[i];
+    uint8_t *out = _bitmaps + g.offset;
+    f.seek(fileOffsets[i]);
+    for (uint8_t y = 0; y < g.height; y++) {
+      row[g.width] = 0; // odd widths pad the last byte with a blank pixel
+      f.read(row, g.width);
+      for (uint8_t x = 0; x < g.width; x += 2) {
+        *out++ = ((row[x] * 15 + 127) / 255) << 4 | (row[x + 1] * 15 + 127) / 255;
+      }
+    }
+  }
+  f.close();
+
+  if (DEBUG) { Serial.printf("Cached %u glyphs (%u bytes) from %s\n", _count, cacheSize, path); }
+  return true;
+}
+
+const GlyphCache::Glyph *GlyphCache::find(uint16_t unicode) const {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_glyphs[i].unicode == unicode) return &_glyphs[i];
+  }
+  return nullptr;
+}
+
+int16_t GlyphCache::textWidth(const char *text) const {
+  int16_t width = 0;
+  while (*text) {
+    const Glyph *g = find(nextChar(text));
+    width += g ? g->xAdvance : _spaceWidth;
+  }
+  return width;
+}
+
+void GlyphCache::renderRow(const char *text, int16_t row, int16_t penX, uint8_t *out, int16_t w) const {
+  memset(out, 0, w);
+  while (*text) {
+    const Glyph *g = find(nextChar(text));
+    if (!g) {
+      penX += _spaceWidth;
+      continue;
+    }
+    int16_t gy = row - (_ascent - g->dY);
+    if (gy >= 0 && gy < g->height) {
+      const uint8_t *bits = _bitmaps + g->offset + gy * ((g->width + 1) / 2);
+      for (uint8_t gx = 0; gx < g->width; gx++) {
+        uint8_t alpha = (gx & 1) ? bits[gx / 2] & 0x0F : bits[gx / 2] >> 4;
+        int16_t px = penX + g->dX + gx;
+        if (alpha && px >= 0 && px < w) out[px] = alpha;
+      }
+    }
+    penX += g->xAdvance;
+  }
+}
+
+bool CachedText::update(TFT_eSPI &tft, const char *text, uint16_t colour, uint16_t bg) {
+  if (colour == lastColour && pixels && strcmp(text, last) == 0) {
+    return false;
+  }
+  int16_t h = font.height();
+  int16_t stride = (width + 1) / 2;
+  bool all = !pixels || colour != lastColour; // a new palette changes every pixel
+  if (!pixels) {
+    pixels = (uint8_t *)calloc(stride, h);
+    if (!pixels) {
+      return false;
+    }
+  }
+  int16_t left = datum == TC_DATUM ? x - width / 2 : datum == TR_DATUM ? x - width : x;
+  int16_t textW = font.textWidth(text);
+  int16_t inset = datum == TC_DATUM ? (width - textW) / 2 : datum == TR_DATUM ? width - textW : 0;
+
+  // Composite the new text into the copy, noting the rectangle that changed
+  int16_t x0 = width, x1 = -1, y0 = h, y1 = -1;
+  uint8_t row[TFT_WIDTH + 1];
+  for (int16_t r = 0; r < h; r++) {
+    font.renderRow(text, r, inset, row, width);
+    row[width] = 0;
+    uint8_t *packed = pixels + r * stride;
+    for (int16_t i = 0; i < stride; i++) {
+      uint8_t b = row[2 * i] << 4 | row[2 * i + 1];
+      if (b != packed[i]) {
+        int16_t first = (b >> 4) != (packed[i] >> 4) ? 2 * i : 2 * i + 1;
+        int16_t last = (b & 0x0F) != (packed[i] & 0x0F) ? 2 * i + 1 : 2 * i;
+        if (first < x0) x0 = first;
+        if (last > x1) x1 = last;
+        if (r < y0) y0 = r;
+        y1 = r;
+        packed[i] = b;
+      }
+    }
+  }
+  if (all) {
+    x0 = y0 = 0;
+    x1 = width - 1;
+    y1 = h - 1;
+  }
+  if (x1 >= width) {
+    x1 = width - 1; // the pad nibble of an odd width
+  }
+  lastColour = colour;
+  strlcpy(last, text, sizeof(last));
+  if (x1 < x0) {
+    return false; // the same pixels, e.g. a reading that only changed past the edge
+  }
+
+  // 16 shades between the background and the text colour
+  uint16_t palette[16];
+  for (uint8_t a = 0; a < 16; a++) {
+    uint16_t c = a == 0 ? bg : a == 15 ? colour : tft.alphaBlend(a * 17, colour, bg);
+    palette[a] = tft.getSwapBytes() ? c : (c >> 8) | (c << 8); // pushPixels wants panel byte order
+  }
+
+  int16_t w = x1 - x0 + 1;
+  uint16_t line[TFT_WIDTH];
+  tft.startWrite();
+  tft.setAddrWindow(left + x0, y + y0, w, y1 - y0 + 1);
+  for (int16_t r = y0; r <= y1; r++) {
+    const uint8_t *packed = pixels + r * stride;
+    for (int16_t i = 0; i < w; i++) {
+      int16_t px = x0 + i;
+      line[i] = palette[(px & 1) ? packed[px / 2] & 0x0F : packed[px / 2] >> 4];
+    }
+    tft.pushPixels(line, w);
+  }
+  tft.endWrite();
+  spiCount.window(w * (y1 - y0 + 1));
+  return true;
+}
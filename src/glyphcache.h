@@ -0,0 +1,79 @@
+/*
+
+Smooth font glyphs kept in RAM, so the readings can be redrawn without
+loadFont() re-reading and re-parsing a .vlw file from SPIFFS every loop.
+
+load() reads the .vlw once and keeps only the characters asked for, with
+their anti-aliasing reduced to 4 bits a pixel (the 36pt digits are ~2.8 KB).
+
+CachedText is a fixed box on the screen with an off-screen copy of what it
+shows, 4 bits a pixel like the glyphs (a 16 colour sprite: 2.2 KB for the
+CO2 reading). A new value is composited into the copy a row at a time, and
+only the rectangle of pixels that came out different is pushed, through one
+address window, blended against the background from a 16 entry palette. So
+1,021 -> 1,022 sends one digit rather than the whole padded reading, an
+unchanged value sends nothing, and nothing is ever cleared first, so it
+doesn't flicker.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#define GLYPH_CACHE_MAX 16 // glyphs per font
+
+class GlyphCache {
+public:
+  // Load the glyphs for the (UTF-8) characters in chars from a .vlw file.
+  // Metrics match what tft.loadFont() would give for the same file.
+  bool load(const char *path, const char *chars);
+
+  uint8_t height() const { return _ascent + _descent; }
+  int16_t textWidth(const char *text) const;
+
+  // One row of text starting penX pixels in: the alpha (0-15) of each of
+  // the w pixels in out
+  void renderRow(const char *text, int16_t row, int16_t penX, uint8_t *out, int16_t w) const;
+
+private:
+  struct Glyph {
+    uint16_t unicode;
+    uint8_t width;
+    uint8_t height;
+    uint8_t xAdvance;
+    int8_t dY; // rows above the baseline
+    int8_t dX;
+    uint16_t offset; // into _bitmaps, (width + 1) / 2 bytes a row
+  };
+
+  const Glyph *find(uint16_t unicode) const;
+
+  Glyph _glyphs[GLYPH_CACHE_MAX];
+  uint8_t _count = 0;
+  uint8_t *_bitmaps = nullptr;
+  uint8_t _ascent = 0;
+  uint8_t _descent = 0;
+  uint8_t _spaceWidth = 0;
+};
+
+// A piece of text at a fixed spot on the screen, in a box width pixels wide
+// and a line high placed by datum (TL/TC/TR) at x,y. Text that doesn't fit
+// is cut off.
+struct CachedText {
+  const GlyphCache &font;
+  int16_t x;
+  int16_t y;
+  uint8_t datum;
+  uint16_t width;
+
+  char last[16] = "";
+  uint16_t lastColour = 0;
+  uint8_t *pixels = nullptr; // what the box shows, 2 pixels a byte; allocated on the first update
+
+  CachedText(const GlyphCache &font, int16_t x, int16_t y, uint8_t datum, uint16_t width)
+    : font(font), x(x), y(y), datum(datum), width(width) {}
+
+  // Show text, pushing just the pixels that change; true if anything was drawn
+  bool update(TFT_eSPI &tft, const char *text, uint16_t colour, uint16_t bg = TFT_BLACK);
+};
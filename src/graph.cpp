@@ -0,0 +1,94 @@
+#include "graph.h"
+#include "spicount.h"
+
+// Rows of unchanged pixels worth pushing to save starting another address window
+#define GRAPH_MERGE_GAP 5
+
+static const uint8_t EMPTY_TOP = 0xFF;
+
+void ScrollingGraph::setStyle(GraphStyle style) {
+  if (style != _style) {
+    _style = style;
+    _cleared = false;
+  }
+}
+
+uint8_t ScrollingGraph::rowOf(uint16_t value) const {
+  if (value >= _maxValue) {
+    return 0; // to stop big values from yeeting off the graph
+  }
+  return (_rows - 1) - (uint32_t)value * (_rows - 1) / _maxValue;
+}
+
+uint16_t ScrollingGraph::pixelAt(const Span &span, uint8_t row) {
+  return row >= span.top && row <= span.bottom ? span.colour : TFT_BLACK;
+}
+
+void ScrollingGraph::drawColumn(TFT_eSPI &tft, uint8_t column, const Span &old, const Span &now) {
+  uint16_t pixels[GRAPH_MAX_ROWS];
+  int16_t runStart = -1, runEnd = -1;
+
+  // Push each run of rows that differ; close runs are merged into one window
+  for (int16_t row = 0; row <= _rows; row++) {
+    bool differs = false;
+    if (row < _rows) {
+      differs = pixelAt(old, row) != pixelAt(now, row);
+    }
+    if (differs) {
+      if (runStart < 0) runStart = row;
+      runEnd = row;
+    } else if (runStart >= 0 && (row == _rows || row - runEnd > GRAPH_MERGE_GAP)) {
+      uint8_t len = runEnd - runStart + 1;
+      for (uint8_t i = 0; i < len; i++) {
+        uint16_t c = pixelAt(now, runStart + i);
+        pixels[i] = tft.getSwapBytes() ? c : (c >> 8) | (c << 8); // pushPixels wants panel byte order
+      }
+      tft.setAddrWindow(_x + column, _y + runStart, 1, len);
+      tft.pushPixels(pixels, len);
+      lastPixels += len;
+      spiCount.window(len);
+      runStart = -1;
+    }
+  }
+}
+
+void ScrollingGraph::plot(TFT_eSPI &tft, const uint16_t *values, uint8_t count, uint16_t (*colourOf)(uint16_t value)) {
+  lastPixels = 0;
+  if (!_cleared) { // first plot or the style changed: start from a blank area
+    tft.fillRect(_x, _y, _columns, _rows, TFT_BLACK);
+    spiCount.window(_columns * _rows);
+    for (uint8_t column = 0; column < _columns; column++) {
+      _spans[column].top = EMPTY_TOP;
+      _spans[column].bottom = 0;
+      _spans[column].colour = TFT_BLACK;
+    }
+    _cleared = true;
+  }
+
+  tft.startWrite();
+  uint8_t previous = 0;
+  for (uint8_t column = 0; column < _columns; column++) {
+    Span now = { EMPTY_TOP, 0, TFT_BLACK };
+    if (column < count) {
+      uint8_t row = rowOf(values[column]);
+      now.colour = colourOf(values[column]);
+      now.top = row;
+      now.bottom = row;
+      if (_style == GRAPH_AREA) {
+        now.bottom = _rows - 1;
+      } else if (_style == GRAPH_LINE && column > 0) {
+        // reach back to (but not onto) the previous value's row
+        if (previous + 1 < row) now.top = previous + 1;
+        if (previous > row + 1) now.bottom = previous - 1;
+      }
+      previous = row;
+    }
+
+    Span &old = _spans[column];
+    if (now.top != old.top || now.bottom != old.bottom || (now.colour != old.colour && now.top != EMPTY_TOP)) {
+      drawColumn(tft, column, old, now);
+      old = now;
+    }
+  }
+  tft.endWrite();
+}
@@ -0,0 +1,60 @@
+/*
+
+CO2 graph on the TFT that only sends the pixels that changed.
+
+The panel can't scroll sideways in our orientation (and reading pixels
+back over SPI is slow), so the graph keeps what it drew in each column as a
+span of rows and a colour (4 bytes a column). When the values shift along,
+each column's new span is compared with the old one and only the rows that
+differ are pushed, a few pixels per column instead of clearing and
+replotting the whole area.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#define GRAPH_MAX_COLUMNS 128
+#define GRAPH_MAX_ROWS 64
+
+enum GraphStyle {
+  GRAPH_DOTS, // one pixel per value
+  GRAPH_LINE, // dots joined to their neighbours
+  GRAPH_AREA  // filled down to the axis
+};
+
+class ScrollingGraph {
+public:
+  // x/y is the top left of the plot area, maxValue is plotted on the top row
+  ScrollingGraph(int16_t x, int16_t y, uint8_t columns, uint8_t rows, uint16_t maxValue, GraphStyle style = GRAPH_DOTS)
+    : _x(x), _y(y), _columns(columns), _rows(rows), _maxValue(maxValue), _style(style) {}
+
+  void setStyle(GraphStyle style);
+  // Show values (oldest first, at most columns of them) from the left edge.
+  // colourOf picks each value's colour.
+  void plot(TFT_eSPI &tft, const uint16_t *values, uint8_t count, uint16_t (*colourOf)(uint16_t value));
+
+  // Pixels pushed by the last plot(), for the curious
+  uint16_t lastPixels = 0;
+
+private:
+  struct Span {
+    uint8_t top;    // rows from the top of the plot, top > bottom when empty
+    uint8_t bottom;
+    uint16_t colour;
+  };
+
+  static uint16_t pixelAt(const Span &span, uint8_t row);
+  uint8_t rowOf(uint16_t value) const;
+  void drawColumn(TFT_eSPI &tft, uint8_t column, const Span &old, const Span &now);
+
+  int16_t _x;
+  int16_t _y;
+  uint8_t _columns;
+  uint8_t _rows;
+  uint16_t _maxValue;
+  GraphStyle _style;
+  bool _cleared = false; // false until the area is known to be blank
+  Span _spans[GRAPH_MAX_COLUMNS];
+};
@@ -0,0 +1,213 @@
+#include "gzip.h"
+#include <new>
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+static_assert(GZIP_WINDOW > MAX_MATCH, "the window has to hold the lookahead");
+#define ROOM_PER_SYMBOL 6 // bytes a literal or match can take, at most 31 bits plus what's still in bits
+
+// Length codes 257..285 and distance codes 0..29: the first value of each, and its extra bits
+static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// CRC-32 a nibble at a time, so the table is 64 bytes rather than 1 KB
+static const uint32_t crcNibble[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+    crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static uint16_t hash(const uint8_t *p) {
+  return ((uint32_t)(p[0] | p[1] << 8 | p[2] << 16) * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+GzipStream::~GzipStream() {
+  delete _state;
+}
+
+bool GzipStream::begin() {
+  delete _state;
+  _state = new (std::nothrow) State();
+  if (!_state) {
+    return false;
+  }
+  // gzip header: deflate, no name or time, unknown OS
+  static const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+  memcpy(_state->out, header, sizeof(header));
+  _state->outLen = sizeof(header);
+  putBits(1, 1); // the one and only block, BFINAL
+  putBits(1, 2); // fixed Huffman codes
+  return true;
+}
+
+void GzipStream::putBits(uint32_t value, uint8_t count) {
+  State &s = *_state;
+  s.bits |= value << s.bitCount;
+  s.bitCount += count;
+  while (s.bitCount >= 8) {
+    s.out[s.outLen++] = s.bits;
+    s.bits >>= 8;
+    s.bitCount -= 8;
+  }
+}
+
+// Huffman codes go most significant bit first, unlike everything else
+void GzipStream::putCode(uint16_t code, uint8_t length) {
+  uint16_t reversed = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    reversed = reversed << 1 | (code & 1);
+    code >>= 1;
+  }
+  putBits(reversed, length);
+}
+
+// The fixed literal/length code: 0-143 8 bits, 144-255 9 bits, 256-279 7 bits, 280-287 8 bits
+void GzipStream::putLiteral(uint8_t c) {
+  if (c < 144) {
+    putCode(0x30 + c, 8);
+  } else {
+    putCode(0x190 + c - 144, 9);
+  }
+}
+
+void GzipStream::putMatch(uint16_t length, uint16_t distance) {
+  uint8_t i = 28;
+  while (lengthBase[i] > length) i--;
+  uint16_t symbol = 257 + i;
+  if (symbol < 280) {
+    putCode(symbol - 256, 7);
+  } else {
+    putCode(0xC0 + symbol - 280, 8);
+  }
+  putBits(length - lengthBase[i], lengthExtra[i]);
+
+  i = 29;
+  while (distanceBase[i] > distance) i--;
+  putCode(i, 5);
+  putBits(distance - distanceBase[i], distanceExtra[i]);
+}
+
+void GzipStream::insert(uint16_t pos) {
+  State &s = *_state;
+  uint16_t h = hash(s.buf + pos);
+  s.prev[pos & (GZIP_WINDOW - 1)] = s.head[h];
+  s.head[h] = pos + 1;
+}
+
+// Code what's in the buffer, keeping MAX_MATCH bytes of lookahead unless flushing
+void GzipStream::compress(bool flush) {
+  State &s = *_state;
+  while (s.outLen + ROOM_PER_SYMBOL <= GZIP_OUT && (flush ? s.pos < s.end : s.end - s.pos >= MAX_MATCH)) {
+    uint16_t lookahead = s.end - s.pos;
+    uint16_t best = 0, bestDistance = 0;
+    if (lookahead >= MIN_MATCH) {
+      uint16_t maxLength = lookahead < MAX_MATCH ? lookahead : MAX_MATCH;
+      uint16_t candidate = s.head[hash(s.buf + s.pos)];
+      for (uint8_t tries = GZIP_CHAIN; candidate && tries; tries--) {
+        uint16_t from = candidate - 1;
+        uint16_t distance = s.pos - from;
+        if (distance >= GZIP_WINDOW) {
+          break; // older ones have been overwritten in prev[]
+        }
+        const uint8_t *a = s.buf + from;
+        const uint8_t *b = s.buf + s.pos;
+        if (a[best] == b[best]) { // can't beat the best without matching there
+          uint16_t length = 0;
+          while (length < maxLength && a[length] == b[length]) length++;
+          if (length > best) {
+            best = length;
+            bestDistance = distance;
+            if (length == maxLength) break;
+          }
+        }
+        candidate = s.prev[from & (GZIP_WINDOW - 1)];
+      }
+    }
+    if (best >= MIN_MATCH) {
+      putMatch(best, bestDistance);
+    } else {
+      best = 1;
+      putLiteral(s.buf[s.pos]);
+    }
+    while (best--) {
+      if (s.end - s.pos >= MIN_MATCH) insert(s.pos);
+      s.pos++;
+    }
+  }
+}
+
+size_t GzipStream::write(const uint8_t *data, size_t len) {
+  if (!_state) {
+    return 0;
+  }
+  State &s = *_state;
+  compress(false); // whatever the last call couldn't fit
+  size_t taken = 0;
+  while (taken < len) {
+    if (s.end == sizeof(s.buf)) {
+      if (s.pos < GZIP_WINDOW) {
+        break; // the output buffer is full, nothing more can be compressed yet
+      }
+      // slide the window down; positions in the hash tables move with it
+      memmove(s.buf, s.buf + GZIP_WINDOW, GZIP_WINDOW);
+      s.pos -= GZIP_WINDOW;
+      s.end -= GZIP_WINDOW;
+      for (uint16_t &p : s.head) p = p > GZIP_WINDOW ? p - GZIP_WINDOW : 0;
+      for (uint16_t &p : s.prev) p = p > GZIP_WINDOW ? p - GZIP_WINDOW : 0;
+    }
+    size_t n = sizeof(s.buf) - s.end;
+    if (n > len - taken) n = len - taken;
+    memcpy(s.buf + s.end, data + taken, n);
+    s.crc = crc32(s.crc, data + taken, n);
+    s.size += n;
+    s.end += n;
+    taken += n;
+    compress(false);
+  }
+  return taken;
+}
+
+bool GzipStream::finish() {
+  if (!_state || _state->finished) {
+    return true;
+  }
+  State &s = *_state;
+  compress(true);
+  if (s.pos < s.end || s.outLen + 10 > GZIP_OUT) {
+    return false; // read() some first
+  }
+  putCode(0, 7); // end of block
+  putBits(0, (8 - s.bitCount) & 7);
+  putBits(s.crc, 16);
+  putBits(s.crc >> 16, 16);
+  putBits(s.size, 16);
+  putBits(s.size >> 16, 16);
+  s.finished = true;
+  return true;
+}
+
+size_t GzipStream::read(uint8_t *out, size_t max) {
+  size_t n = available();
+  if (n > max) n = max;
+  if (n == 0) {
+    return 0;
+  }
+  State &s = *_state;
+  memcpy(out, s.out + s.outPos, n);
+  s.outPos += n;
+  if (s.outPos == s.outLen) {
+    s.outLen = s.outPos = 0;
+  }
+  return n;
+}
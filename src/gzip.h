@@ -0,0 +1,66 @@
+/*
+
+Streaming gzip in a few KB, for compressing downloads as they are generated.
+
+It's deflate with a small window: LZ77 matches found through hash chains
+over the last GZIP_WINDOW bytes, coded with deflate's fixed Huffman codes
+(so there are no code tables to build or send). Text as repetitive as CSV
+rows still comes out at around a quarter of its size. The whole state is
+one block of about 3.5 KB, allocated by begin().
+
+Data goes in through write() and compressed bytes come out through read();
+write() takes less than it was given when the output buffer is full, so the
+caller drains it with read() and offers the rest again. After the last
+write(), finish() flushes what's left and adds the gzip trailer; it returns
+false while there's output to read() before it can get that far.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define GZIP_WINDOW 512 // bytes back a match can reach, a power of 2
+#define GZIP_HASH_BITS 9
+#define GZIP_CHAIN 8    // candidates tried per position
+#define GZIP_OUT 512    // compressed bytes held for read()
+
+class GzipStream {
+public:
+  ~GzipStream();
+  // Allocate the state and queue the gzip header; false if out of memory
+  bool begin();
+  // Compress up to len bytes; returns how many were taken
+  size_t write(const uint8_t *data, size_t len);
+  // End of the data: compress the rest and queue the trailer. false if the
+  // output buffer filled first: read() and call it again.
+  bool finish();
+  size_t available() const { return _state ? _state->outLen - _state->outPos : 0; }
+  size_t read(uint8_t *out, size_t max);
+
+  uint32_t in() const { return _state ? _state->size : 0; } // bytes written so far
+
+private:
+  struct State {
+    uint8_t buf[2 * GZIP_WINDOW];  // the window, then the data not compressed yet
+    uint16_t head[1 << GZIP_HASH_BITS]; // latest position + 1 with each hash, 0 for none
+    uint16_t prev[GZIP_WINDOW];    // the position + 1 before it with the same hash
+    uint8_t out[GZIP_OUT];
+    uint16_t pos;  // next byte of buf to compress
+    uint16_t end;  // bytes in buf
+    uint16_t outLen, outPos;
+    uint32_t bits; // not yet a whole byte, lowest first
+    uint8_t bitCount;
+    uint32_t crc;
+    uint32_t size;
+    bool finished;
+  };
+
+  void compress(bool flush);
+  void insert(uint16_t pos);
+  void putBits(uint32_t value, uint8_t count);
+  void putCode(uint16_t code, uint8_t length);
+  void putLiteral(uint8_t c);
+  void putMatch(uint16_t length, uint16_t distance);
+
+  State *_state = nullptr;
+};
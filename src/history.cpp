@@ -0,0 +1,264 @@
+#include "history.h"
+
+SampleRing history;
+
+static BucketTier::Record quarterRecords[HISTORY_QUARTER_BUCKETS];
+static BucketTier::Record hourRecords[HISTORY_HOUR_BUCKETS];
+BucketTier quarterHourly(15 * 60, quarterRecords, HISTORY_QUARTER_BUCKETS);
+BucketTier hourly(60 * 60, hourRecords, HISTORY_HOUR_BUCKETS);
+
+void addSample(time_t time, uint16_t co2, int16_t temp, uint16_t humidity) {
+  history.push(time, co2, temp, humidity);
+  if (time >= HISTORY_VALID_TIME) { // uptime stamps would land in 1970 buckets
+    quarterHourly.add(time, co2, temp, humidity);
+    hourly.add(time, co2, temp, humidity);
+  }
+}
+
+uint32_t retimeSamples(time_t offset) {
+  uint32_t first = history.retime(offset);
+  HistoryCursor cursor = history.cursor(first);
+  Sample sample;
+  while (history.read(cursor, sample)) {
+    quarterHourly.add(sample.time, sample.co2, sample.temp, sample.humidity);
+    hourly.add(sample.time, sample.co2, sample.temp, sample.humidity);
+  }
+  return first;
+}
+
+// Time of sample n given the time of sample n-1
+time_t SampleRing::timeOf(uint32_t n, time_t previous) const {
+  uint16_t dt = _records[n % HISTORY_SAMPLES].dt;
+  if (dt != DT_ANCHOR) {
+    return previous + dt;
+  }
+  for (uint8_t i = 0; i < ANCHORS; i++) {
+    if (_anchors[i].n == n) {
+      return _anchors[i].time;
+    }
+  }
+  return previous; // anchor was recycled; best we can do
+}
+
+void SampleRing::push(time_t time, uint16_t co2, int16_t temp, uint16_t humidity) {
+  if (_size == HISTORY_SAMPLES) {
+    // the oldest record is about to be overwritten, so the next one becomes the base
+    _firstTime = timeOf(first() + 1, _firstTime);
+    _size--;
+  }
+
+  Record &r = _records[_pushed % HISTORY_SAMPLES];
+  if (_size == 0) {
+    r.dt = 0;
+    _firstTime = time;
+  } else if (time >= _lastTime && time - _lastTime < DT_ANCHOR) {
+    r.dt = time - _lastTime;
+  } else { // clock jumped (NTP sync, reboot gap, ...)
+    r.dt = DT_ANCHOR;
+    _anchors[_nextAnchor].n = _pushed;
+    _anchors[_nextAnchor].time = time;
+    _nextAnchor = (_nextAnchor + 1) % ANCHORS;
+  }
+  r.co2 = co2;
+  r.temp = temp;
+  r.humidity = humidity;
+
+  _lastTime = time;
+  _pushed++;
+  _size++;
+}
+
+HistoryCursor SampleRing::cursor(uint32_t n) const {
+  HistoryCursor cursor = { first(), _firstTime };
+  if (n > _pushed) {
+    n = _pushed;
+  }
+  while (cursor.n < n) {
+    cursor.n++;
+    if (cursor.n < _pushed) {
+      cursor.time = timeOf(cursor.n, cursor.time);
+    }
+  }
+  return cursor;
+}
+
+bool SampleRing::read(HistoryCursor &cursor, Sample &out) const {
+  if (cursor.n < first()) {
+    cursor.n = first();
+    cursor.time = _firstTime;
+  }
+  if (cursor.n >= _pushed) {
+    return false;
+  }
+  const Record &r = _records[cursor.n % HISTORY_SAMPLES];
+  out.time = cursor.time;
+  out.co2 = r.co2;
+  out.temp = r.temp;
+  out.humidity = r.humidity;
+
+  cursor.n++;
+  if (cursor.n < _pushed) {
+    cursor.time = timeOf(cursor.n, cursor.time);
+  }
+  return true;
+}
+
+bool SampleRing::readBack(HistoryCursor &cursor, Sample &out) const {
+  if (cursor.n < first() || cursor.n >= _pushed) { // (past the oldest, n has wrapped round to the top)
+    return false;
+  }
+  const Record &r = _records[cursor.n % HISTORY_SAMPLES];
+  out.time = cursor.time;
+  out.co2 = r.co2;
+  out.temp = r.temp;
+  out.humidity = r.humidity;
+
+  if (cursor.n == first()) {
+    cursor.n--;
+  } else if (cursor.n - 1 == first()) {
+    cursor.n--;
+    cursor.time = _firstTime;
+  } else if (r.dt != DT_ANCHOR) {
+    cursor.n--;
+    cursor.time -= r.dt;
+  } else {
+    cursor = this->cursor(cursor.n - 1);
+  }
+  return true;
+}
+
+uint32_t SampleRing::retime(time_t offset) {
+  // find where the trailing run of uptime stamps starts
+  uint32_t start = _pushed;
+  HistoryCursor cursor = this->cursor(first());
+  Sample sample;
+  uint32_t n = cursor.n;
+  while (read(cursor, sample)) {
+    if (sample.time >= HISTORY_VALID_TIME) {
+      start = _pushed;
+    } else if (start == _pushed) {
+      start = n;
+    }
+    n = cursor.n;
+  }
+  if (start == _pushed) {
+    return start;
+  }
+
+  // only the run's base time (and any anchors inside it) are absolute, the rest are deltas
+  for (n = start; n < _pushed; n++) {
+    if (n == first()) {
+      _firstTime += offset;
+    } else if (_records[n % HISTORY_SAMPLES].dt == DT_ANCHOR) {
+      for (uint8_t i = 0; i < ANCHORS; i++) {
+        if (_anchors[i].n == n) {
+          _anchors[i].time += offset;
+        }
+      }
+    }
+  }
+  _lastTime += offset;
+  return start;
+}
+
+void BucketTier::close() {
+  Record &r = _records[_pushed % _capacity];
+  if (_count == 0) {
+    r.co2Min = 0xFFFF;
+    r.co2Max = 0;
+    r.co2Mean = 0;
+    r.temp = 0;
+    r.humidity = 0;
+  } else {
+    r.co2Min = _co2Min;
+    r.co2Max = _co2Max;
+    r.co2Mean = (_co2Sum + _count / 2) / _count;
+    r.temp = _tempSum / _count;
+    r.humidity = (_humiditySum + _count / 2) / _count;
+  }
+  if (_size == _capacity) {
+    _firstTime += _period;
+  } else {
+    if (_size == 0) {
+      _firstTime = _start;
+    }
+    _size++;
+  }
+  _pushed++;
+  _start += _period;
+  _count = 0;
+}
+
+void BucketTier::add(time_t time, uint16_t co2, int16_t temp, uint16_t humidity) {
+  time_t start = time - time % _period;
+  if (_start == 0) {
+    _start = start;
+  } else if (start > _start) {
+    if ((start - _start) / _period > _capacity) {
+      // gap longer than the whole tier: nothing held would survive it anyway
+      _size = 0;
+      _count = 0;
+      _start = start;
+    }
+    while (_start < start) { // close the open bucket plus any empty ones in between
+      close();
+    }
+  }
+  // a sample from an earlier period (clock stepped back a little) joins the open bucket
+
+  if (_count == 0) {
+    _co2Min = co2;
+    _co2Max = co2;
+    _co2Sum = 0;
+    _tempSum = 0;
+    _humiditySum = 0;
+  }
+  if (co2 < _co2Min) _co2Min = co2;
+  if (co2 > _co2Max) _co2Max = co2;
+  _co2Sum += co2;
+  _tempSum += temp;
+  _humiditySum += humidity;
+  _count++;
+}
+
+HistoryCursor BucketTier::cursor(uint32_t n) const {
+  if (n < first()) {
+    n = first();
+  }
+  if (n > _pushed) {
+    n = _pushed;
+  }
+  HistoryCursor cursor = { n, _firstTime + (time_t)(n - first()) * _period };
+  return cursor;
+}
+
+bool BucketTier::read(HistoryCursor &cursor, Bucket &out) const {
+  if (cursor.n < first()) {
+    cursor = this->cursor(first());
+  }
+  while (cursor.n < _pushed) {
+    const Record &r = _records[cursor.n % _capacity];
+    time_t start = _firstTime + (time_t)(cursor.n - first()) * _period;
+    cursor.n++;
+    if (r.co2Min <= r.co2Max) {
+      out.time = start;
+      out.co2Min = r.co2Min;
+      out.co2Mean = r.co2Mean;
+      out.co2Max = r.co2Max;
+      out.temp = r.temp;
+      out.humidity = r.humidity;
+      return true;
+    }
+  }
+  if (cursor.n == _pushed && _count > 0) { // the open bucket, as it stands
+    cursor.n++;
+    out.time = _start;
+    out.co2Min = _co2Min;
+    out.co2Mean = (_co2Sum + _count / 2) / _count;
+    out.co2Max = _co2Max;
+    out.temp = _tempSum / _count;
+    out.humidity = (_humiditySum + _count / 2) / _count;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,171 @@
+/*
+
+Packed ring of one-minute samples: 8 bytes a sample instead of the 14 that
+four parallel CircularBuffers (time_t, uint16_t, float, float) cost.
+
+Each record keeps the seconds since the sample before it rather than a full
+timestamp. The ring remembers the absolute time of its oldest sample and
+walks forward from there, so reading in order is O(1) per sample. Gaps too
+big (or negative) for 16 bits are parked in a small anchor table.
+
+Temperature and humidity are stored as hundredths (2150 = 21.50).
+
+Samples taken before NTP has synced are stamped with the uptime, and moved
+to wall-clock time once it is known (retime()).
+
+Older history is rolled up into 15-minute and hourly buckets as samples
+arrive (BucketTier). Buckets are contiguous in time, so a bucket's start is
+worked out from its position and only the values are stored: 10 bytes each.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define HISTORY_SAMPLES 1440 // one-minute samples = 24 hours
+#define HISTORY_QUARTER_BUCKETS 672 // 15-minute buckets = 7 days
+#define HISTORY_HOUR_BUCKETS 720 // hourly buckets = 30 days
+
+// Anything earlier is uptime rather than wall-clock time (NTP hasn't synced)
+#define HISTORY_VALID_TIME 1577836800 // 2020-01-01
+
+// One decoded sample
+struct Sample {
+  time_t time;
+  uint16_t co2;      // ppm
+  int16_t temp;      // centi-degrees C
+  uint16_t humidity; // centi-percent RH
+};
+
+// A reading position in the ring. Cursors stay valid across pushes: if the
+// sample they point at has been overwritten they skip to the oldest one left.
+struct HistoryCursor {
+  uint32_t n;  // sample number (see SampleRing::pushed())
+  time_t time; // time of sample n
+};
+
+class SampleRing {
+public:
+  void push(time_t time, uint16_t co2, int16_t temp, uint16_t humidity);
+
+  uint16_t size() const { return _size; }
+  // Samples ever pushed. Sample numbers count up from 0 and are never reused.
+  uint32_t pushed() const { return _pushed; }
+  // Number of the oldest sample still held
+  uint32_t first() const { return _pushed - _size; }
+  time_t lastTime() const { return _lastTime; }
+  // CO2 of sample n, which must still be held
+  uint16_t co2At(uint32_t n) const { return _records[n % HISTORY_SAMPLES].co2; }
+  // Readings of sample n, which must still be held; its time is left alone (cursor() has that)
+  void valuesAt(uint32_t n, Sample &out) const {
+    const Record &r = _records[n % HISTORY_SAMPLES];
+    out.co2 = r.co2;
+    out.temp = r.temp;
+    out.humidity = r.humidity;
+  }
+
+  // Cursor at sample n (or the oldest held, if n has gone). O(n - first()).
+  HistoryCursor cursor(uint32_t n) const;
+  // Read the sample under the cursor and step past it; false at the end
+  bool read(HistoryCursor &cursor, Sample &out) const;
+  // Read the sample under the cursor and step back to the one before it;
+  // false once past the oldest. O(1) but across a clock jump (an anchor),
+  // where the time before it is found with cursor().
+  bool readBack(HistoryCursor &cursor, Sample &out) const;
+
+  // Add offset to the newest samples if they were stamped with uptime
+  // (before NTP synced). Returns the number of the first one moved, or
+  // pushed() if there were none.
+  uint32_t retime(time_t offset);
+
+private:
+  struct Record {
+    uint16_t dt; // seconds since the previous sample, or DT_ANCHOR
+    uint16_t co2;
+    int16_t temp;
+    uint16_t humidity;
+  };
+  struct Anchor {
+    uint32_t n;
+    time_t time;
+  };
+  static const uint16_t DT_ANCHOR = 0xFFFF;
+  static const uint8_t ANCHORS = 8;
+
+  time_t timeOf(uint32_t n, time_t previous) const;
+
+  Record _records[HISTORY_SAMPLES];
+  Anchor _anchors[ANCHORS];
+  uint8_t _nextAnchor = 0;
+  uint32_t _pushed = 0;
+  uint16_t _size = 0;
+  time_t _firstTime = 0;
+  time_t _lastTime = 0;
+};
+
+// One decoded roll-up bucket
+struct Bucket {
+  time_t time; // start of the bucket
+  uint16_t co2Min;
+  uint16_t co2Mean;
+  uint16_t co2Max;
+  int16_t temp;      // mean, centi-degrees C
+  uint16_t humidity; // mean, centi-percent RH
+};
+
+// min/mean/max roll-up of samples into fixed, time-aligned periods. Each
+// sample costs O(1): it is folded into the open bucket, which is written
+// into the ring once a sample from a later period turns up.
+class BucketTier {
+public:
+  struct Record {
+    uint16_t co2Min; // > co2Max for a period with no samples
+    uint16_t co2Mean;
+    uint16_t co2Max;
+    int16_t temp;
+    uint16_t humidity;
+  };
+
+  BucketTier(uint32_t period, Record *records, uint16_t capacity)
+    : _period(period), _records(records), _capacity(capacity) {}
+
+  void add(time_t time, uint16_t co2, int16_t temp, uint16_t humidity);
+
+  uint32_t period() const { return _period; }
+  // Buckets ever closed, numbered like SampleRing samples
+  uint32_t pushed() const { return _pushed; }
+  uint32_t first() const { return _pushed - _size; }
+
+  // Cursor at bucket n (or the oldest held). The open bucket is read last.
+  HistoryCursor cursor(uint32_t n) const;
+  // Read the next non-empty bucket; false at the end
+  bool read(HistoryCursor &cursor, Bucket &out) const;
+
+private:
+  void close();
+
+  uint32_t _period;
+  Record *_records;
+  uint16_t _capacity;
+  uint16_t _size = 0;
+  uint32_t _pushed = 0;
+  time_t _firstTime = 0; // start of the oldest bucket held
+
+  // the open bucket
+  time_t _start = 0;
+  uint16_t _count = 0;
+  uint16_t _co2Min, _co2Max;
+  uint32_t _co2Sum;
+  int32_t _tempSum;
+  uint32_t _humiditySum;
+};
+
+extern SampleRing history;
+extern BucketTier quarterHourly;
+extern BucketTier hourly;
+
+// Record a new one-minute sample into the ring and every roll-up tier
+void addSample(time_t time, uint16_t co2, int16_t temp, uint16_t humidity);
+// NTP has synced: shift the samples stamped with uptime by offset and roll
+// them up now their buckets are known. Returns the first one moved.
+uint32_t retimeSamples(time_t offset);
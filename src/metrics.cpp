@@ -0,0 +1,209 @@
+#include "metrics.h"
+#include "scheduler.h"
+#include "history.h"
+#include "flashlog.h"
+#include "wifilink.h"
+#include "uplink.h"
+#include "spicount.h"
+
+Metrics metrics;
+
+// µs: 100µs .. 1s
+static const uint32_t TIME_BOUNDS[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000 };
+// bytes: up to a couple of TCP segments
+static const uint32_t CHUNK_BOUNDS[] = { 64, 128, 256, 512, 1024, 1460, 2048, 2920 };
+
+#define COUNT_OF(a) (sizeof(a) / sizeof(a[0]))
+
+void Histogram::observe(uint32_t value) {
+  uint8_t i = 0;
+  while (i < _count && value > _bounds[i]) {
+    i++;
+  }
+  _buckets[i]++;
+  _sum += value;
+  _observations++;
+}
+
+// value / scale with up to 6 decimals, without going through float (or 64 bit printf)
+static void printScaled(Print &out, uint64_t value, uint32_t scale) {
+  if (scale == 1) {
+    out.printf("%lu", (unsigned long)value);
+    return;
+  }
+  uint32_t fraction = value % scale * 1000000 / scale;
+  out.printf("%lu.%06lu", (unsigned long)(value / scale), (unsigned long)fraction);
+}
+
+void Histogram::print(Print &out, const char *name, const char *labels, uint32_t scale) const {
+  uint32_t cumulative = 0;
+  const char *sep = labels[0] ? "," : "";
+  for (uint8_t i = 0; i <= _count; i++) {
+    cumulative += _buckets[i];
+    out.printf("%s_bucket{%s%sle=\"", name, labels, sep);
+    if (i < _count) {
+      printScaled(out, _bounds[i], scale);
+    } else {
+      out.print("+Inf");
+    }
+    out.printf("\"} %lu\n", (unsigned long)cumulative);
+  }
+  char braced[48] = "";
+  if (labels[0]) {
+    snprintf(braced, sizeof(braced), "{%s}", labels);
+  }
+  out.printf("%s_sum%s ", name, braced);
+  printScaled(out, _sum, scale);
+  out.printf("\n%s_count%s %lu\n", name, braced, (unsigned long)_observations);
+}
+
+Metrics::Metrics()
+  : _loop(TIME_BOUNDS, COUNT_OF(TIME_BOUNDS)),
+    _sensor(TIME_BOUNDS, COUNT_OF(TIME_BOUNDS)),
+    _chunks(CHUNK_BOUNDS, COUNT_OF(CHUNK_BOUNDS)) {}
+
+void Metrics::addRoute(const char *path) {
+  if (_routeCount < METRICS_MAX_ROUTES) {
+    _routes[_routeCount++] = new Route{ path, Histogram(TIME_BOUNDS, COUNT_OF(TIME_BOUNDS)) };
+  }
+}
+
+void Metrics::route(const char *path, uint32_t us) {
+  for (uint8_t i = 0; i < _routeCount; i++) {
+    if (_routes[i]->path == path || strcmp(_routes[i]->path, path) == 0) {
+      _routes[i]->time.observe(us);
+      return;
+    }
+  }
+}
+
+void timeRoute(AsyncWebServerRequest *request, const char *path) {
+  uint32_t start = micros();
+  request->onDisconnect([path, start]() {
+    metrics.route(path, micros() - start);
+  });
+}
+
+static void header(Print &out, const char *name, const char *type, const char *help) {
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+bool Metrics::printBlock(Print &out, uint8_t block) const {
+  // one block per route histogram, the rest are fixed
+  if (block >= 4 && block < 4 + _routeCount) {
+    char labels[40];
+    snprintf(labels, sizeof(labels), "route=\"%s\"", _routes[block - 4]->path);
+    _routes[block - 4]->time.print(out, "co2_http_handler_seconds", labels, 1000000);
+    return true;
+  }
+  if (block >= 4) {
+    block -= _routeCount;
+  }
+
+  switch (block) {
+  case 0:
+    header(out, "co2_uptime_seconds", "counter", "Seconds since boot");
+    out.printf("co2_uptime_seconds %lu\n", (unsigned long)(millis() / 1000));
+    header(out, "co2_heap_free_bytes", "gauge", "Free heap");
+    out.printf("co2_heap_free_bytes %lu\n", (unsigned long)ESP.getFreeHeap());
+    header(out, "co2_heap_max_block_bytes", "gauge", "Largest allocatable block");
+    out.printf("co2_heap_max_block_bytes %lu\n", (unsigned long)ESP.getMaxFreeBlockSize());
+    header(out, "co2_heap_fragmentation_percent", "gauge", "Heap fragmentation");
+    out.printf("co2_heap_fragmentation_percent %u\n", ESP.getHeapFragmentation());
+    header(out, "co2_samples_total", "counter", "Samples added to the history");
+    out.printf("co2_samples_total %lu\n", (unsigned long)history.pushed());
+    header(out, "co2_log_write_errors_total", "counter", "Failed flash log writes");
+    out.printf("co2_log_write_errors_total %lu\n", (unsigned long)flashLog.writeErrors);
+    header(out, "co2_wifi_connects_total", "counter", "Successful Wi-Fi associations (more than one means it dropped out)");
+    out.printf("co2_wifi_connects_total %lu\n", (unsigned long)wifiLink.connects());
+    header(out, "co2_wifi_failures_total", "counter", "Wi-Fi connection attempts that timed out");
+    out.printf("co2_wifi_failures_total %lu\n", (unsigned long)wifiLink.failures());
+    return true;
+  case 1:
+    header(out, "co2_loop_seconds", "histogram", "Busy time of each scheduler pass");
+    _loop.print(out, "co2_loop_seconds", "", 1000000);
+    return true;
+  case 2:
+    header(out, "co2_sensor_read_seconds", "histogram", "Time to read a measurement from the SCD30");
+    _sensor.print(out, "co2_sensor_read_seconds", "", 1000000);
+    return true;
+  case 3:
+    header(out, "co2_http_handler_seconds", "histogram", "Response time by route (until the connection closes)");
+    return true;
+  case 4:
+    header(out, "co2_table_chunk_bytes", "histogram", "Size of each chunk of a /table response");
+    _chunks.print(out, "co2_table_chunk_bytes", "", 1);
+    return true;
+  case 5:
+    header(out, "co2_task_runs_total", "counter", "Scheduler task runs");
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+      out.printf("co2_task_runs_total{task=\"%s\"} %lu\n", scheduler.task(i).name, (unsigned long)scheduler.task(i).runs);
+    }
+    header(out, "co2_task_skipped_total", "counter", "Scheduler task runs skipped because the task fell behind");
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+      out.printf("co2_task_skipped_total{task=\"%s\"} %lu\n", scheduler.task(i).name, (unsigned long)scheduler.task(i).skipped);
+    }
+    header(out, "co2_task_max_seconds", "gauge", "Longest single run of each scheduler task");
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+      out.printf("co2_task_max_seconds{task=\"%s\"} ", scheduler.task(i).name);
+      printScaled(out, scheduler.task(i).maxUs, 1000000);
+      out.print("\n");
+    }
+    return true;
+  case 6:
+    header(out, "co2_tft_pixels_total", "counter", "Pixels sent to the display");
+    out.printf("co2_tft_pixels_total %lu\n", (unsigned long)spiCount.pixels);
+    header(out, "co2_tft_windows_total", "counter", "Address windows set on the display");
+    out.printf("co2_tft_windows_total %lu\n", (unsigned long)spiCount.windows);
+    header(out, "co2_tft_spi_bytes_total", "counter", "Bytes sent to the display over SPI");
+    out.printf("co2_tft_spi_bytes_total %llu\n", (unsigned long long)spiCount.bytes());
+    if (uplink.enabled()) {
+      header(out, "co2_uplink_frames_total", "counter", "Frames the collector acknowledged");
+      out.printf("co2_uplink_frames_total %lu\n", (unsigned long)uplink.frames());
+      header(out, "co2_uplink_samples_total", "counter", "Samples in them");
+      out.printf("co2_uplink_samples_total %lu\n", (unsigned long)uplink.samples());
+      header(out, "co2_uplink_failures_total", "counter", "Frames that didn't get through");
+      out.printf("co2_uplink_failures_total %lu\n", (unsigned long)uplink.failures());
+      header(out, "co2_uplink_backlog_samples", "gauge", "Logged samples the collector doesn't have yet");
+      out.printf("co2_uplink_backlog_samples %lu\n", (unsigned long)uplink.backlog());
+    }
+    return true;
+  }
+  return false;
+}
+
+// Print into MetricsCursor::pending
+class PendingPrint : public Print {
+public:
+  explicit PendingPrint(MetricsCursor &cursor) : _cursor(cursor) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t size) override {
+    size_t room = sizeof(_cursor.pending) - _cursor.pendingLen;
+    if (size > room) size = room; // a block that doesn't fit is cut short rather than overflowing
+    memcpy(_cursor.pending + _cursor.pendingLen, data, size);
+    _cursor.pendingLen += size;
+    return size;
+  }
+
+private:
+  MetricsCursor &_cursor;
+};
+
+int getMetricsChunk(char *buffer, int maxLen, MetricsCursor &cursor) {
+  int len = 0;
+  while (len < maxLen) {
+    if (cursor.pendingPos == cursor.pendingLen) {
+      cursor.pendingLen = cursor.pendingPos = 0;
+      PendingPrint out(cursor);
+      if (!metrics.printBlock(out, cursor.block++)) {
+        break;
+      }
+    }
+    size_t n = cursor.pendingLen - cursor.pendingPos;
+    if (n > (size_t)(maxLen - len)) n = maxLen - len;
+    memcpy(buffer + len, cursor.pending + cursor.pendingPos, n);
+    cursor.pendingPos += n;
+    len += n;
+  }
+  return len;
+}
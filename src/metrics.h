@@ -0,0 +1,84 @@
+/*
+
+Runtime telemetry, served as Prometheus text on /metrics so a fleet of
+badges can be scraped and the ones running out of heap spotted early. The
+page (~10 KB) is streamed in blocks rather than built up in RAM.
+
+Timings go into fixed-bucket histograms (a few dozen bytes each, no
+allocation): scheduler pass time, each web route's response time and sensor
+read time. /table chunks are counted by size, and heap free, largest free
+block and fragmentation are sampled when scraped.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define METRICS_MAX_ROUTES 12
+#define METRICS_BLOCK_SIZE 1280 // the biggest block is one route's histogram
+
+// Cumulative histogram over fixed upper bounds, as Prometheus wants it
+class Histogram {
+public:
+  Histogram(const uint32_t *bounds, uint8_t count) : _bounds(bounds), _count(count) {}
+
+  void observe(uint32_t value);
+  // scale divides the bounds and sum on the way out, e.g. 1000000 for µs -> seconds
+  void print(Print &out, const char *name, const char *labels, uint32_t scale) const;
+
+private:
+  static const uint8_t MAX_BUCKETS = 12;
+  const uint32_t *_bounds;
+  uint8_t _count;
+  uint32_t _buckets[MAX_BUCKETS + 1] = {}; // last one is +Inf
+  uint64_t _sum = 0;
+  uint32_t _observations = 0;
+};
+
+class Metrics {
+public:
+  Metrics();
+
+  void loopPass(uint32_t us) { _loop.observe(us); }
+  void sensorRead(uint32_t us) { _sensor.observe(us); }
+  void tableChunk(size_t bytes) { _chunks.observe(bytes); }
+  // Give a route its series; all of them at startup, so the page (and its
+  // block numbers) doesn't change shape mid-scrape when a route is first hit
+  void addRoute(const char *path);
+  void route(const char *path, uint32_t us);
+
+  // Write block n of the page; false once past the last one. The page is
+  // streamed a block at a time so it never has to fit in the heap whole.
+  bool printBlock(Print &out, uint8_t block) const;
+
+private:
+  Histogram _loop;
+  Histogram _sensor;
+  Histogram _chunks;
+
+  struct Route {
+    const char *path;
+    Histogram time;
+  };
+  Route *_routes[METRICS_MAX_ROUTES];
+  uint8_t _routeCount = 0;
+};
+
+extern Metrics metrics;
+
+// Where a /metrics response is up to, like TableCursor
+struct MetricsCursor {
+  uint8_t block;
+  uint16_t pendingLen;
+  uint16_t pendingPos;
+  char pending[METRICS_BLOCK_SIZE];
+};
+
+int getMetricsChunk(char *buffer, int maxLen, MetricsCursor &cursor);
+
+// Times a request under path from here until its connection closes, so a
+// chunked response counts until its last chunk has gone rather than until
+// the handler returns:
+//   timeRoute(request, "/table");
+void timeRoute(AsyncWebServerRequest *request, const char *path);
@@ -0,0 +1,210 @@
+#include "samplecodec.h"
+
+#define RICE_LIMIT 24    // unary bits before a value is escaped and written whole
+#define RICE_WINDOW 16   // values the running mean covers, roughly
+#define RICE_START_SUM 8 // what a fresh block expects: changes of a few units
+
+enum { FIELD_TIME, FIELD_CO2, FIELD_TEMP, FIELD_HUMIDITY };
+
+static uint32_t zigzag32(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag32(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint16_t zigzag16(int16_t v) {
+  return ((uint16_t)v << 1) ^ (uint16_t)(v >> 15);
+}
+
+static int16_t unzigzag16(uint16_t v) {
+  return (int16_t)(v >> 1) ^ -(int16_t)(v & 1);
+}
+
+static void putHeader(uint8_t *p, uint16_t count, const Sample &s) {
+  uint32_t time = s.time;
+  p[0] = count;
+  p[1] = count >> 8;
+  p[2] = time;
+  p[3] = time >> 8;
+  p[4] = time >> 16;
+  p[5] = time >> 24;
+  p[6] = s.co2;
+  p[7] = s.co2 >> 8;
+  p[8] = s.temp;
+  p[9] = (uint16_t)s.temp >> 8;
+  p[10] = s.humidity;
+  p[11] = s.humidity >> 8;
+}
+
+void RiceState::reset() {
+  sum = RICE_START_SUM;
+  count = 1;
+}
+
+// The smallest k with 2^k at least the mean
+uint8_t RiceState::k() const {
+  uint8_t k = 0;
+  while (((uint32_t)count << k) < sum && k < 31) k++;
+  return k;
+}
+
+void RiceState::update(uint32_t value) {
+  sum += value > 0xFFFF ? 0xFFFF : value; // an escaped outlier shouldn't swamp the mean
+  if (++count == RICE_WINDOW) {
+    sum >>= 1;
+    count >>= 1;
+  }
+}
+
+void SampleEncoder::begin(uint8_t *out, uint16_t size) {
+  _out = out;
+  _size = size;
+  _bits = CODEC_HEADER_BYTES * 8;
+  _count = 0;
+  for (RiceState &r : _rice) r.reset();
+}
+
+bool SampleEncoder::put(uint32_t value, uint8_t count) {
+  if (_bits + count > (uint32_t)_size * 8) {
+    return false;
+  }
+  while (count) {
+    uint8_t offset = _bits & 7;
+    uint8_t n = 8 - offset < count ? 8 - offset : count;
+    uint8_t &byte = _out[_bits / 8];
+    if (offset == 0) byte = 0;
+    byte |= (value & ((1u << n) - 1)) << offset;
+    value >>= n;
+    count -= n;
+    _bits += n;
+  }
+  return true;
+}
+
+bool SampleEncoder::putRice(uint32_t value, RiceState &state, uint8_t rawBits) {
+  uint8_t k = state.k();
+  uint32_t q = value >> k;
+  state.update(value);
+  if (q >= RICE_LIMIT) {
+    return put(0xFFFFFF, RICE_LIMIT) && put(value, rawBits);
+  }
+  // q ones, a zero, then the low k bits
+  return put((1u << q) - 1, q) && put(0, 1) && (k == 0 || put(value, k));
+}
+
+bool SampleEncoder::add(const Sample &s) {
+  if (_count == 0) {
+    if (_size < CODEC_HEADER_BYTES) {
+      return false;
+    }
+    putHeader(_out, 1, s);
+    _count = 1;
+    _last = s;
+    _lastInterval = 0;
+    return true;
+  }
+
+  uint32_t mark = _bits;
+  RiceState saved[4];
+  memcpy(saved, _rice, sizeof(saved));
+
+  uint32_t interval = (uint32_t)s.time - (uint32_t)_last.time;
+  bool fits = putRice(zigzag32(interval - _lastInterval), _rice[FIELD_TIME], 32)
+    && putRice(zigzag16(s.co2 - _last.co2), _rice[FIELD_CO2], 16)
+    && putRice(zigzag16(s.temp - _last.temp), _rice[FIELD_TEMP], 16)
+    && putRice(zigzag16(s.humidity - _last.humidity), _rice[FIELD_HUMIDITY], 16);
+  if (!fits) {
+    // take back the bits written so far: the rest of the byte at mark (bits
+    // go in low first, so its low mark & 7 are kept) and the bytes after it
+    uint32_t from = mark / 8, to = (_bits + 7) / 8;
+    if (from < to) {
+      _out[from] &= (1u << (mark & 7)) - 1;
+      memset(_out + from + 1, 0, to - from - 1);
+    }
+    _bits = mark;
+    memcpy(_rice, saved, sizeof(saved));
+    return false;
+  }
+  _count++;
+  _out[0] = _count;
+  _out[1] = _count >> 8;
+  _last = s;
+  _lastInterval = interval;
+  return true;
+}
+
+bool SampleDecoder::begin(const uint8_t *block, uint16_t len) {
+  _in = block;
+  _lenBits = (uint32_t)len * 8;
+  _bits = CODEC_HEADER_BYTES * 8;
+  _done = 0;
+  _count = len >= CODEC_HEADER_BYTES ? block[0] | block[1] << 8 : 0;
+  for (RiceState &r : _rice) r.reset();
+  return len >= CODEC_HEADER_BYTES;
+}
+
+bool SampleDecoder::get(uint32_t &value, uint8_t count) {
+  if (_bits + count > _lenBits) {
+    return false;
+  }
+  value = 0;
+  for (uint8_t shift = 0; shift < count;) {
+    uint8_t offset = _bits & 7;
+    uint8_t n = 8 - offset < count - shift ? 8 - offset : count - shift;
+    value |= (uint32_t)((_in[_bits / 8] >> offset) & ((1u << n) - 1)) << shift;
+    shift += n;
+    _bits += n;
+  }
+  return true;
+}
+
+bool SampleDecoder::getRice(uint32_t &value, RiceState &state, uint8_t rawBits) {
+  uint8_t k = state.k();
+  uint32_t q = 0;
+  uint32_t bit;
+  while (true) {
+    if (!get(bit, 1)) return false;
+    if (!bit) break;
+    if (++q == RICE_LIMIT) {
+      if (!get(value, rawBits)) return false;
+      state.update(value);
+      return true;
+    }
+  }
+  uint32_t low = 0;
+  if (k > 0 && !get(low, k)) return false;
+  value = q << k | low;
+  state.update(value);
+  return true;
+}
+
+bool SampleDecoder::next(Sample &s) {
+  if (_done >= _count) {
+    return false;
+  }
+  if (_done == 0) {
+    const uint8_t *p = _in;
+    _last.time = (uint32_t)(p[2] | p[3] << 8 | p[4] << 16 | (uint32_t)p[5] << 24);
+    _last.co2 = p[6] | p[7] << 8;
+    _last.temp = (int16_t)(p[8] | p[9] << 8);
+    _last.humidity = p[10] | p[11] << 8;
+    _lastInterval = 0;
+  } else {
+    uint32_t dod, co2, temp, humidity;
+    if (!getRice(dod, _rice[FIELD_TIME], 32) || !getRice(co2, _rice[FIELD_CO2], 16)
+        || !getRice(temp, _rice[FIELD_TEMP], 16) || !getRice(humidity, _rice[FIELD_HUMIDITY], 16)) {
+      _done = _count; // cut short
+      return false;
+    }
+    _lastInterval += unzigzag32(dod);
+    _last.time = (uint32_t)_last.time + _lastInterval;
+    _last.co2 += unzigzag16(co2);
+    _last.temp += unzigzag16(temp);
+    _last.humidity += unzigzag16(humidity);
+  }
+  _done++;
+  s = _last;
+  return true;
+}
@@ -0,0 +1,96 @@
+/*
+
+Compact coding for a stream of samples, so the uplink sends each in a
+fraction of the 8 bytes it took in the first frame format.
+
+Samples go in blocks that decode on their own, so a reader can start at any
+block. A block is a 12 byte header holding the number of samples and the
+first sample whole, then a bit stream with, for each sample after it:
+
+  time      the change in the interval since the previous sample (delta of
+            delta), which is 0 for samples taken on a steady beat
+  co2, temperature, humidity
+            the change from the previous sample
+
+each zigzagged (0, -1, 1, -2, ... as 0, 1, 2, 3, ...) and Rice coded: the
+value shifted right by k in unary, then its low k bits. k adapts to each
+field as the block goes, from the running mean of its recent values, the
+same on both sides, so a field that barely moves costs a bit or two and a
+noisy one only as many as its noise. A value too big for the unary part is
+escaped and written whole. Differences wrap (time modulo 2^32, the readings
+modulo 2^16), so any sequence round-trips exactly, in or out of order.
+
+tools/codec_bench.cpp measures it on recorded traces.
+
+The history ring and the flash log keep their fixed-size records (8 and 12
+bytes). Both are read by sample number at random: pages sorted by a
+reading, LTTB's pair of cursors, stepping back through the ring, retime()
+rewriting times in place, the log's binary search by time and the
+uplink's saved position. In blocks each of those would be a decode from
+the start of a block, and the log would need an index of its blocks per
+segment and would lose a whole block rather than one record to a torn
+write. The ring is a day by design, older history being the buckets, so
+packing it wouldn't keep more; the log could keep about five weeks instead
+of one in the same flash, and is where to start if that's wanted.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include "history.h"
+
+#define CODEC_HEADER_BYTES 12
+
+// Adaptive Rice parameter for one field, see samplecodec.cpp
+struct RiceState {
+  uint32_t sum;
+  uint8_t count;
+  void reset();
+  uint8_t k() const;
+  void update(uint32_t value);
+};
+
+class SampleEncoder {
+public:
+  // Start a block in out, which holds at most size bytes
+  void begin(uint8_t *out, uint16_t size);
+  // Add a sample; false, and the block is left as it was, if it doesn't fit
+  bool add(const Sample &s);
+  uint16_t count() const { return _count; }
+  // Length of the block so far
+  uint16_t bytes() const { return _count ? (_bits + 7) / 8 : 0; }
+
+private:
+  bool put(uint32_t value, uint8_t count);
+  bool putRice(uint32_t value, RiceState &state, uint8_t rawBits);
+
+  uint8_t *_out = nullptr;
+  uint16_t _size = 0;
+  uint32_t _bits = 0; // bits used, header included
+  uint16_t _count = 0;
+  Sample _last;
+  uint32_t _lastInterval;
+  RiceState _rice[4]; // time, co2, temp, humidity
+};
+
+class SampleDecoder {
+public:
+  // false if len is too short for a block header
+  bool begin(const uint8_t *block, uint16_t len);
+  // The next sample; false after the last (or if the block is cut short)
+  bool next(Sample &s);
+  uint16_t count() const { return _count; }
+
+private:
+  bool get(uint32_t &value, uint8_t count);
+  bool getRice(uint32_t &value, RiceState &state, uint8_t rawBits);
+
+  const uint8_t *_in = nullptr;
+  uint32_t _lenBits = 0;
+  uint32_t _bits = 0;
+  uint16_t _count = 0;
+  uint16_t _done = 0;
+  Sample _last;
+  uint32_t _lastInterval;
+  RiceState _rice[4];
+};
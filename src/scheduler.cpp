@@ -0,0 +1,69 @@
+#include "scheduler.h"
+
+Scheduler scheduler;
+
+bool Scheduler::add(const char *name, uint32_t period, void (*run)(), uint32_t delay) {
+  if (_count == SCHEDULER_MAX_TASKS) {
+    return false;
+  }
+  Task &t = _tasks[_count++];
+  t.name = name;
+  t.period = period;
+  t.run = run;
+  t.due = millis() + delay;
+  t.runs = 0;
+  t.skipped = 0;
+  t.totalUs = 0;
+  t.maxUs = 0;
+  return true;
+}
+
+void Scheduler::run(uint32_t maxSleep) {
+  uint32_t passStart = micros();
+  for (uint8_t i = 0; i < _count; i++) {
+    Task &t = _tasks[i];
+    uint32_t now = millis();
+    if ((int32_t)(now - t.due) < 0) {
+      continue;
+    }
+
+    uint32_t start = micros();
+    t.run();
+    uint32_t took = micros() - start;
+    t.runs++;
+    t.totalUs += took;
+    if (took > t.maxUs) t.maxUs = took;
+
+    t.due += t.period;
+    if ((int32_t)(millis() - t.due) >= 0) { // still behind: skip the runs we missed
+      uint32_t behind = millis() - t.due;
+      t.skipped += behind / t.period + 1;
+      t.due += (behind / t.period + 1) * t.period;
+    }
+    yield(); // let WiFi have a look in between tasks
+  }
+  lastPassUs = micros() - passStart;
+  if (lastPassUs > maxPassUs) maxPassUs = lastPassUs;
+
+  // Sleep until something is due; delay() hands the CPU to the WiFi stack meanwhile
+  uint32_t sleep = maxSleep;
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < _count; i++) {
+    int32_t until = _tasks[i].due - now;
+    if (until <= 0) {
+      return;
+    }
+    if ((uint32_t)until < sleep) sleep = until;
+  }
+  delay(sleep);
+}
+
+void Scheduler::printStats(Print &out) const {
+  out.printf("%-10s %8s %8s %8s %8s %8s\n", "task", "period", "runs", "skipped", "mean_us", "max_us");
+  for (uint8_t i = 0; i < _count; i++) {
+    const Task &t = _tasks[i];
+    out.printf("%-10s %8lu %8lu %8lu %8lu %8lu\n", t.name, (unsigned long)t.period, (unsigned long)t.runs,
+               (unsigned long)t.skipped, (unsigned long)(t.runs ? t.totalUs / t.runs : 0), (unsigned long)t.maxUs);
+  }
+  out.printf("longest pass: %lu us\n", (unsigned long)maxPassUs);
+}
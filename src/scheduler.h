@@ -0,0 +1,55 @@
+/*
+
+Small cooperative scheduler: each task is a plain function with its own
+period, run from loop() when it falls due. Between tasks loop() sleeps only
+until the next deadline, so the LED can breathe at 100 Hz while the sensor
+is polled once a second.
+
+Deadlines advance by exactly one period, so a one-minute task doesn't drift.
+A task that falls more than a period behind (e.g. a slow flash write) skips
+the missed runs instead of firing them back to back.
+
+Every task's run time is measured, see /tasks.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS 8
+
+struct Task {
+  const char *name;
+  uint32_t period; // ms
+  void (*run)();
+
+  uint32_t due;      // millis() of the next run
+  uint32_t runs;
+  uint32_t skipped;  // runs missed because the task fell behind
+  uint32_t totalUs;  // time spent running, wraps after ~71 minutes of CPU
+  uint32_t maxUs;
+};
+
+class Scheduler {
+public:
+  // Add a task, first run on the next pass (or delay ms from now)
+  bool add(const char *name, uint32_t period, void (*run)(), uint32_t delay = 0);
+  // Run whatever is due, then sleep until the next deadline (at most maxSleep ms)
+  void run(uint32_t maxSleep = 10);
+
+  uint8_t count() const { return _count; }
+  const Task &task(uint8_t i) const { return _tasks[i]; }
+  // How long the last pass of run() kept loop() busy (not counting the
+  // sleep), and the longest one yet
+  uint32_t lastPassUs = 0;
+  uint32_t maxPassUs = 0;
+
+  // Write a line per task: name, period, runs, mean & max run time
+  void printStats(Print &out) const;
+
+private:
+  Task _tasks[SCHEDULER_MAX_TASKS];
+  uint8_t _count = 0;
+};
+
+extern Scheduler scheduler;
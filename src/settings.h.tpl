@@ -18,6 +18,21 @@
 #define PPM_ORANGE          1200
 #define PPM_RED             1600
 #define LED_ALARM           1800 // ppm that LED should illuminate
+#define ALARM_LEAD          10   // minutes: blink the LED this long before the trend says LED_ALARM will be reached
+#define ALARM_HYSTERESIS    100  // ppm below LED_ALARM a reading has to drop to before the alarm goes off again
+
+#define GRAPH_STYLE         GRAPH_DOTS // TFT graph: GRAPH_DOTS, GRAPH_LINE or GRAPH_AREA
+#define GRAPH_MINUTES       96    // history the TFT graph spans, up to 1440; more than its 96 columns is thinned to fit
+
+// Push the logged samples to a collector in batches (see README), e.g. tools/collector.py
+#define UPLINK_URL          ""    // "http://host[:port]/path", or "" for no uplink
+#define UPLINK_INTERVAL     300   // seconds between batches
+
+// Sensor traces (see README): record the real SCD30's readings to /trace.bin, or with
+// FAKE_SENSOR play one back instead of made-up data
+#define TRACE_RECORD        false // (bool)
+#define TRACE_REPLAY        ""    // trace file on SPIFFS to play back, e.g. "/trace.bin"
+#define TRACE_SPEEDUP       1     // play the trace back this many times faster than it was recorded
 
 // If you wired your SCD30 sensor to different pins, edit here:
 #define SCD30_SDA           D3
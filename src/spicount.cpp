@@ -0,0 +1,3 @@
+#include "spicount.h"
+
+SpiCount spiCount;
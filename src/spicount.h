@@ -0,0 +1,29 @@
+/*
+
+What keeping the display up to date costs on the SPI bus, for /metrics.
+
+Each push to the panel sets an address window (CASET, RASET and RAMWR: 11
+bytes of commands and arguments) and then sends 2 bytes a pixel. The code
+that draws the parts of the screen that change counts both, so rate() of the
+counters gives the pixels and bytes a second going to the display.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define SPI_WINDOW_BYTES 11
+
+struct SpiCount {
+  uint32_t windows = 0;
+  uint32_t pixels = 0;
+
+  // An address window filled with this many pixels
+  void window(uint32_t n) {
+    windows++;
+    pixels += n;
+  }
+  uint64_t bytes() const { return (uint64_t)pixels * 2 + (uint64_t)windows * SPI_WINDOW_BYTES; }
+};
+
+extern SpiCount spiCount;
@@ -0,0 +1,183 @@
+#include "stats.h"
+#include "format.h"
+
+// Edit to taste; each window is sliced into STATS_SLOTS, so its length should divide by that
+RollingWindow co2Windows[STATS_WINDOWS] = {
+  { "5m", 5 * 60 },
+  { "15m", 15 * 60 },
+  { "1h", 60 * 60 },
+  { "8h", 8 * 60 * 60 }, // the workplace exposure TWA
+};
+
+uint32_t statsUptime() {
+  static uint32_t lastMs = 0;
+  static uint32_t seconds = 0;
+  static uint32_t remainder = 0;
+  uint32_t ms = millis();
+  remainder += ms - lastMs;
+  lastMs = ms;
+  seconds += remainder / 1000;
+  remainder %= 1000;
+  return seconds;
+}
+
+void RollingWindow::Deque::push(uint32_t slot, uint16_t value, bool keepMin) {
+  // anything behind that can never be the min (max) again goes
+  while (size > 0) {
+    const Entry &back = entries[(head + size - 1) % STATS_SLOTS];
+    if (keepMin ? back.value < value : back.value > value) {
+      break;
+    }
+    size--;
+  }
+  Entry &e = entries[(head + size) % STATS_SLOTS];
+  e.slot = slot;
+  e.value = value;
+  size++;
+}
+
+void RollingWindow::Deque::expire(uint32_t oldest) {
+  while (size > 0 && entries[head].slot < oldest) {
+    head = (head + 1) % STATS_SLOTS;
+    size--;
+  }
+}
+
+// Move the open slot on to slot, dropping whatever slides out of the window
+void RollingWindow::slide(uint32_t slot) {
+  if (slot - _current >= STATS_SLOTS) { // gap longer than the window: nothing survives it
+    memset(_slots, 0, sizeof(_slots));
+    _count = 0;
+    _sum = 0;
+    _sumSq = 0;
+    _mins.size = 0;
+    _maxes.size = 0;
+    _current = slot;
+    return;
+  }
+  while (_current < slot) {
+    Slot &closed = _slots[_current % STATS_SLOTS];
+    if (closed.count > 0) {
+      _mins.push(_current, closed.min, true);
+      _maxes.push(_current, closed.max, false);
+    }
+    _current++;
+
+    Slot &reused = _slots[_current % STATS_SLOTS];
+    _count -= reused.count;
+    _sum -= reused.sum;
+    _sumSq -= reused.sumSq;
+    memset(&reused, 0, sizeof(reused));
+    uint32_t oldest = _current >= STATS_SLOTS - 1 ? _current - (STATS_SLOTS - 1) : 0;
+    _mins.expire(oldest);
+    _maxes.expire(oldest);
+  }
+}
+
+void RollingWindow::add(uint32_t now, uint16_t value) {
+  if (!_started) {
+    _started = true;
+    _firstSeen = now;
+    _current = now / _slotSeconds;
+  }
+  slide(now / _slotSeconds);
+
+  Slot &slot = _slots[_current % STATS_SLOTS];
+  if (slot.count == 0 || value < slot.min) slot.min = value;
+  if (slot.count == 0 || value > slot.max) slot.max = value;
+  slot.count++;
+  slot.sum += value;
+  slot.sumSq += (uint32_t)value * value;
+
+  _count++;
+  _sum += value;
+  _sumSq += (uint32_t)value * value;
+}
+
+// floor(sqrt(v)), bit by bit: no float
+static uint32_t isqrt64(uint64_t v) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > v) bit >>= 2;
+  while (bit != 0) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+bool RollingWindow::get(uint32_t now, WindowStats &out) {
+  memset(&out, 0, sizeof(out));
+  if (!_started) {
+    return false;
+  }
+  slide(now / _slotSeconds);
+  if (_count == 0) {
+    return false;
+  }
+
+  // the closed slots are in the deques, the open one isn't yet
+  const Slot &open = _slots[_current % STATS_SLOTS];
+  out.min = 0xFFFF;
+  out.max = 0;
+  if (_mins.size > 0) out.min = _mins.front().value;
+  if (_maxes.size > 0) out.max = _maxes.front().value;
+  if (open.count > 0) {
+    if (open.min < out.min) out.min = open.min;
+    if (open.max > out.max) out.max = open.max;
+  }
+
+  out.count = _count;
+  out.span = now - _firstSeen < seconds ? now - _firstSeen : seconds;
+  out.mean = (_sum * 10 + _count / 2) / _count;
+  // n²·variance = n·Σx² - (Σx)², exact in 64 bits (and still so ×100 for tenths)
+  out.stddev = (isqrt64((_count * _sumSq - _sum * _sum) * 100) + _count / 2) / _count;
+  return true;
+}
+
+void addStatsReading(uint16_t co2) {
+  uint32_t now = statsUptime();
+  for (uint8_t i = 0; i < STATS_WINDOWS; i++) {
+    co2Windows[i].add(now, co2);
+  }
+}
+
+int formatStats(char *buffer, size_t size) {
+  if (size < STATS_JSON_MAX) {
+    return 0;
+  }
+  uint32_t now = statsUptime();
+  char *p = buffer;
+  *p++ = '{';
+  for (uint8_t i = 0; i < STATS_WINDOWS; i++) {
+    WindowStats w;
+    if (i > 0) *p++ = ',';
+    *p++ = '"';
+    p = stpcpy(p, co2Windows[i].name);
+    if (!co2Windows[i].get(now, w)) {
+      p = stpcpy(p, "\":{\"n\":0}");
+      continue;
+    }
+    p = stpcpy(p, "\":{\"n\":");
+    p = appendUnsigned(p, w.count);
+    p = stpcpy(p, ",\"span\":");
+    p = appendUnsigned(p, w.span);
+    p = stpcpy(p, ",\"min\":");
+    p = appendUnsigned(p, w.min);
+    p = stpcpy(p, ",\"max\":");
+    p = appendUnsigned(p, w.max);
+    p = stpcpy(p, ",\"mean\":");
+    p = appendCenti(p, w.mean * 10, 1);
+    p = stpcpy(p, ",\"stddev\":");
+    p = appendCenti(p, w.stddev * 10, 1);
+    *p++ = '}';
+  }
+  *p++ = '}';
+  *p = '\0';
+  return p - buffer;
+}
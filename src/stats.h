@@ -0,0 +1,94 @@
+/*
+
+Rolling CO2 statistics over sliding windows (5 min, 15 min, 1 h and an
+8 hour time-weighted average), kept up to date as readings arrive so /stats
+and /api never have to scan the history.
+
+Each window is cut into STATS_SLOTS time slots. A slot holds the count,
+sum, sum of squares, min and max of its readings, and the window keeps
+running totals that a slot is added to as readings arrive and subtracted
+from when it slides out. Sliding min and max come from monotonic deques of
+the slot minima/maxima. Everything is O(1) per reading (amortised for the
+deques) whatever the window length, and a window costs ~800 bytes.
+
+The window edge moves a slot at a time, so a "15 minute" window covers the
+last 14¼ to 15 minutes. Time is the uptime, so an NTP step doesn't disturb
+it.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define STATS_SLOTS 20
+#define STATS_WINDOWS 4
+#define STATS_JSON_MAX 512 // formatStats() output, with window names of up to 8 characters
+
+struct WindowStats {
+  uint32_t count; // readings in the window
+  uint32_t span;  // seconds the window covers so far (less than its length just after boot)
+  uint16_t min;
+  uint16_t max;
+  uint32_t mean;   // tenths of a ppm
+  uint32_t stddev; // tenths of a ppm
+};
+
+class RollingWindow {
+public:
+  RollingWindow(const char *name, uint32_t seconds) : name(name), seconds(seconds), _slotSeconds(seconds / STATS_SLOTS) {}
+
+  void add(uint32_t now, uint16_t value);
+  // false if there have been no readings in the window
+  bool get(uint32_t now, WindowStats &out);
+
+  const char *name;
+  const uint32_t seconds;
+
+private:
+  struct Slot {
+    uint64_t sumSq;
+    uint32_t sum;
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+  };
+  // Slot number and value, oldest first; values are increasing (min) or decreasing (max)
+  struct Deque {
+    struct Entry {
+      uint32_t slot;
+      uint16_t value;
+    };
+    Entry entries[STATS_SLOTS];
+    uint8_t head = 0;
+    uint8_t size = 0;
+
+    void push(uint32_t slot, uint16_t value, bool keepMin);
+    void expire(uint32_t oldest);
+    const Entry &front() const { return entries[head]; }
+  };
+
+  void slide(uint32_t slot);
+
+  uint32_t _slotSeconds;
+  Slot _slots[STATS_SLOTS] = {};
+  uint32_t _current = 0;  // slot number of the open slot
+  bool _started = false;
+  uint32_t _firstSeen = 0; // uptime of the first reading
+
+  uint32_t _count = 0;
+  uint64_t _sum = 0;
+  uint64_t _sumSq = 0;
+  Deque _mins;
+  Deque _maxes;
+};
+
+extern RollingWindow co2Windows[STATS_WINDOWS];
+
+// Seconds since boot, from millis() but without its 49 day wrap: the
+// windows' clock
+uint32_t statsUptime();
+// Feed a new CO2 reading to every window
+void addStatsReading(uint16_t co2);
+// All the windows as a JSON object, {"5m":{"n":..,"min":..,...},...};
+// returns its length (0 if size is under STATS_JSON_MAX)
+int formatStats(char *buffer, size_t size);
@@ -0,0 +1,396 @@
+#include "table.h"
+#include "metrics.h"
+#include "format.h"
+
+// settings.h for DEBUG
+#include "settings.h"
+
+void tableETag(char *out, size_t size) {
+  static uint32_t bootId = 0; // so a reboot that has pushed the same number of samples can't match
+  if (bootId == 0) {
+    bootId = ESP.random() | 1;
+  }
+  snprintf(out, size, "\"%08lx-%lu\"", (unsigned long)bootId, (unsigned long)history.pushed());
+}
+
+TableSource parseResolution(const char *res) {
+  if (strcmp(res, "15m") == 0) return TABLE_QUARTER;
+  if (strcmp(res, "1h") == 0) return TABLE_HOUR;
+  return TABLE_RAW;
+}
+
+// "[time,co2,temp,humidity" of a row, unterminated; the bucket rows carry on from there
+static char *appendRowStart(char *p, time_t time, uint16_t co2, int16_t temp, uint16_t humidity) {
+  *p++ = '[';
+  p = appendUnsigned(p, time);
+  *p++ = ',';
+  p = appendUnsigned(p, co2);
+  *p++ = ',';
+  p = appendCenti(p, temp, 2);
+  *p++ = ',';
+  return appendCenti(p, humidity, 2);
+}
+
+int formatSample(char *out, size_t size, const Sample &s) {
+  if (size < TABLE_ROW_MAX) {
+    return 0;
+  }
+  char *p = appendRowStart(out, s.time, s.co2, s.temp, s.humidity);
+  *p++ = ']';
+  *p = '\0';
+  return p - out;
+}
+
+// "time,co2,temp,humidity" of a CSV row, unterminated
+static char *appendCSVRowStart(char *p, time_t time, uint16_t co2, int16_t temp, uint16_t humidity) {
+  p = appendDateTime(p, time);
+  *p++ = ',';
+  p = appendUnsigned(p, co2);
+  *p++ = ',';
+  p = appendCenti(p, temp, 2);
+  *p++ = ',';
+  return appendCenti(p, humidity, 2);
+}
+
+static const BucketTier &tierFor(TableSource source) {
+  return source == TABLE_HOUR ? hourly : quarterHourly;
+}
+
+// Number of the first sample in the ring later than time (pushed() if there's none)
+static uint32_t sampleAfter(time_t time) {
+  HistoryCursor cursor = history.cursor(history.first());
+  Sample s;
+  uint32_t n = cursor.n;
+  while (history.read(cursor, s) && s.time <= time) {
+    n = cursor.n;
+  }
+  return n;
+}
+
+TableCursor beginTable(TableSource source, time_t from, time_t to, TableFormat format, uint16_t points) {
+  TableCursor cursor = {};
+  cursor.source = source;
+  cursor.format = format;
+  cursor.from = from;
+  cursor.to = to;
+  if (source == TABLE_RAW) {
+    cursor.row = history.cursor(history.first());
+    cursor.endRow = history.pushed();
+  } else if (source == TABLE_LOG) {
+    cursor.log = flashLog.seek(from, to);
+    cursor.endRow = flashLog.end();
+  } else {
+    const BucketTier &tier = tierFor(source);
+    cursor.row = tier.cursor(tier.first());
+    cursor.endRow = tier.pushed() + 1; // + the bucket still filling up
+  }
+
+  if (points > 0 && (source == TABLE_RAW || source == TABLE_LOG)) {
+    // number the rows in range, so they can be split into buckets
+    uint32_t first, end;
+    if (source == TABLE_RAW) {
+      first = from > 0 ? sampleAfter(from - 1) : history.first();
+      end = to < LONG_MAX ? sampleAfter(to) : history.pushed();
+      cursor.row = history.cursor(first);
+      cursor.ahead.row = history.cursor(first + 1);
+    } else {
+      first = flashLog.after(from - 1);
+      end = flashLog.after(to);
+      cursor.log.n = first;
+      cursor.ahead.log = cursor.log;
+      cursor.ahead.log.n = first + 1;
+    }
+    cursor.endRow = end;
+    if (end > first && end - first > points) {
+      cursor.lttb.begin(first, end, points);
+    }
+  }
+  return cursor;
+}
+
+// Where sample n goes in a page's order: the reading (0 for time), then the
+// sample number, which is also time order, for ties
+static uint64_t sortKey(const TableCursor &cursor, uint32_t n) {
+  Sample s;
+  history.valuesAt(n, s);
+  uint16_t v = 0;
+  if (cursor.sortColumn == 1) v = s.co2;
+  if (cursor.sortColumn == 2) v = (uint16_t)s.temp ^ 0x8000; // so -327.68 sorts first
+  if (cursor.sortColumn == 3) v = s.humidity;
+  if (cursor.descending) v = 0xFFFF - v;
+  return (uint64_t)v << 32 | n;
+}
+
+// Key of the row at rank in the page's order, from passes over the ring
+static uint64_t keyAtRank(const TableCursor &cursor, uint32_t rank) {
+  uint32_t first = history.first();
+  // the first reading with more than rank rows at or before it...
+  uint32_t lo = 0, hi = 0xFFFF;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    uint32_t count = 0;
+    for (uint32_t n = first; n < cursor.endRow; n++) {
+      if (sortKey(cursor, n) >> 32 <= mid) count++;
+    }
+    if (count > rank) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  // ...and which of the rows with that reading it is
+  uint32_t before = 0;
+  for (uint32_t n = first; n < cursor.endRow; n++) {
+    if (sortKey(cursor, n) >> 32 < lo) before++;
+  }
+  for (uint32_t n = first; n < cursor.endRow; n++) {
+    uint64_t key = sortKey(cursor, n);
+    if (key >> 32 == lo && before++ == rank) {
+      return key;
+    }
+  }
+  return 0;
+}
+
+TableCursor beginPage(uint32_t draw, uint32_t start, int32_t length, uint8_t column, bool descending) {
+  TableCursor cursor = beginTable(TABLE_RAW);
+  cursor.paged = true;
+  cursor.draw = draw;
+  cursor.sortColumn = column <= 3 ? column : 0;
+  cursor.descending = descending;
+  cursor.total = history.size();
+  if (cursor.sortColumn != 0 && (length < 0 || length > TABLE_PAGE_MAX)) {
+    length = TABLE_PAGE_MAX; // each row is a pass over the ring
+  }
+  uint32_t left = start < cursor.total ? cursor.total - start : 0;
+  cursor.pageLeft = length >= 0 && (uint32_t)length < left ? length : left;
+  if (cursor.pageLeft == 0) {
+    return cursor;
+  }
+  if (cursor.sortColumn == 0) { // time order is sample order: one walk to the page, then it's stepped along
+    cursor.row = history.cursor(descending ? cursor.endRow - 1 - start : history.first() + start);
+  } else {
+    cursor.lastKey = keyAtRank(cursor, start);
+  }
+  return cursor;
+}
+
+// The next row of a page; false once it's all sent
+static bool nextPageRow(TableCursor &cursor, Sample &s) {
+  if (cursor.pageLeft == 0) {
+    return false;
+  }
+  uint32_t first = history.first();
+  if (cursor.sortColumn == 0) {
+    if (cursor.row.n < first || cursor.row.n >= cursor.endRow) {
+      return false; // pushed out of the ring while the page was going out
+    }
+    cursor.pageLeft--;
+    return cursor.descending ? history.readBack(cursor.row, s) : history.read(cursor.row, s);
+  }
+  uint32_t n;
+  if (!cursor.wroteRow) {
+    n = cursor.lastKey; // found by beginPage()
+  } else { // the row with the smallest key after the last one's
+    uint64_t best = UINT64_MAX;
+    for (uint32_t i = first; i < cursor.endRow; i++) {
+      uint64_t key = sortKey(cursor, i);
+      if (key > cursor.lastKey && key < best) best = key;
+    }
+    if (best == UINT64_MAX) {
+      return false;
+    }
+    cursor.lastKey = best;
+    n = best;
+  }
+  if (n < first || n >= cursor.endRow) {
+    return false; // pushed out of the ring while the page was going out
+  }
+  cursor.pageLeft--;
+  HistoryCursor at = history.cursor(n);
+  return history.read(at, s);
+}
+
+static bool readSample(TableCursor &cursor, Sample &s) {
+  if (cursor.source == TABLE_LOG) {
+    return cursor.log.n < cursor.endRow && flashLog.read(cursor.log, s);
+  }
+  return cursor.row.n < cursor.endRow && history.read(cursor.row, s);
+}
+
+// Read the next row of bucket b, from the cursor a bucket in front if ahead
+static bool readBucket(TableCursor &cursor, uint16_t b, bool ahead, Sample &s) {
+  uint32_t end = cursor.lttb.bucketEnd(b);
+  if (cursor.source == TABLE_LOG) {
+    LogCursor &log = ahead ? cursor.ahead.log : cursor.log;
+    return log.n < end && flashLog.read(log, s);
+  }
+  HistoryCursor &row = ahead ? cursor.ahead.row : cursor.row;
+  return row.n < end && history.read(row, s);
+}
+
+// The sample kept from the next bucket; false once they're all done
+static bool nextThinned(TableCursor &cursor, Sample &out) {
+  Lttb &lttb = cursor.lttb;
+  while (lttb.bucket() < lttb.points()) {
+    uint16_t b = lttb.bucket();
+    Sample s;
+    if (b + 1 < lttb.points()) {
+      while (readBucket(cursor, b + 1, true, s)) lttb.aim(s.time, s.co2);
+    }
+    bool found = false;
+    while (readBucket(cursor, b, false, s)) {
+      if (lttb.consider(s.time, s.co2)) {
+        out = s;
+        found = true;
+      }
+    }
+    if (found) {
+      lttb.next(out.time, out.co2);
+      return true;
+    }
+    lttb.next(0, 0); // nothing left of it (overwritten, or failing flash)
+  }
+  return false;
+}
+
+// Render the next row into cursor.pending; false once there are no more.
+// Rows pushed out of the store mid-response are skipped, newer ones are left for next time.
+static bool nextRow(TableCursor &cursor) {
+  if (cursor.source == TABLE_RAW || cursor.source == TABLE_LOG) {
+    Sample s;
+    if (cursor.paged) {
+      if (!nextPageRow(cursor, s)) {
+        return false;
+      }
+    } else if (cursor.lttb.points() > 0) {
+      if (!nextThinned(cursor, s)) {
+        return false;
+      }
+    } else {
+      do {
+        if (!readSample(cursor, s) || s.time > cursor.to) {
+          return false;
+        }
+      } while (s.time < cursor.from);
+    }
+    if (cursor.format == TABLE_CSV) {
+      char *p = appendCSVRowStart(cursor.pending, s.time, s.co2, s.temp, s.humidity);
+      *p++ = '\n';
+      cursor.pendingLen = p - cursor.pending;
+      return true;
+    }
+    char *p = cursor.pending;
+    if (cursor.wroteRow) *p++ = ',';
+    p = appendRowStart(p, s.time, s.co2, s.temp, s.humidity);
+    *p++ = ']';
+    cursor.pendingLen = p - cursor.pending;
+  } else {
+    Bucket b;
+    do {
+      if (cursor.row.n >= cursor.endRow || !tierFor(cursor.source).read(cursor.row, b) || b.time > cursor.to) {
+        return false;
+      }
+    } while (b.time < cursor.from);
+    char *p = cursor.pending;
+    if (cursor.format == TABLE_CSV) {
+      p = appendCSVRowStart(p, b.time, b.co2Mean, b.temp, b.humidity);
+    } else {
+      if (cursor.wroteRow) *p++ = ',';
+      p = appendRowStart(p, b.time, b.co2Mean, b.temp, b.humidity);
+    }
+    *p++ = ',';
+    p = appendUnsigned(p, b.co2Min);
+    *p++ = ',';
+    p = appendUnsigned(p, b.co2Max);
+    *p++ = cursor.format == TABLE_CSV ? '\n' : ']';
+    cursor.pendingLen = p - cursor.pending;
+  }
+  cursor.wroteRow = true;
+  return true;
+}
+
+// Render the next piece of the document into cursor.pending; false once finished
+static bool nextTablePiece(TableCursor &cursor) {
+  if (cursor.stage == 0) {
+    if (cursor.format == TABLE_CSV) {
+      bool buckets = cursor.source == TABLE_QUARTER || cursor.source == TABLE_HOUR;
+      cursor.pendingLen = strlcpy(cursor.pending, buckets ? "time,co2,temp,humidity,co2_min,co2_max\n" : "time,co2,temp,humidity\n", sizeof(cursor.pending));
+    } else {
+      cursor.pendingLen = strlcpy(cursor.pending, "{\"data\":[", sizeof(cursor.pending));
+    }
+    cursor.stage = 1;
+  } else if (cursor.stage == 1) {
+    if (!nextRow(cursor)) {
+      cursor.stage = 2;
+      return nextTablePiece(cursor);
+    }
+  } else if (cursor.stage == 2) {
+    if (cursor.paged) {
+      cursor.pendingLen = snprintf(cursor.pending, sizeof(cursor.pending), "],\"draw\":%lu,\"recordsTotal\":%lu,\"recordsFiltered\":%lu}",
+                                   (unsigned long)cursor.draw, (unsigned long)cursor.total, (unsigned long)cursor.total);
+    } else {
+      cursor.pendingLen = strlcpy(cursor.pending, cursor.format == TABLE_CSV ? "" : "]}", sizeof(cursor.pending));
+    }
+    cursor.stage = 3;
+  } else {
+    return false;
+  }
+  cursor.pendingPos = 0;
+  return true;
+}
+
+static int chunkLimit(int maxLen) {
+  size_t max = (ESP.getFreeHeap() / 3) & 0xFFE0;
+  return (size_t)maxLen > max ? max : maxLen;
+}
+
+// Copy the document out a piece at a time
+static int copyPieces(char *buffer, int maxLen, TableCursor &cursor) {
+  int len = 0;
+  while (len < maxLen) {
+    if (cursor.pendingPos == cursor.pendingLen && !nextTablePiece(cursor)) {
+      break;
+    }
+    size_t n = cursor.pendingLen - cursor.pendingPos;
+    if (n > (size_t)(maxLen - len)) n = maxLen - len;
+    memcpy(buffer + len, cursor.pending + cursor.pendingPos, n);
+    cursor.pendingPos += n;
+    len += n;
+  }
+  return len;
+}
+
+int getJSONChunk(char *buffer, int maxLen, size_t index, TableCursor &cursor) {
+  //Write up to "maxLen" bytes into "buffer" and return the amount written.
+  //index equals the amount of bytes that has been already sent
+  //You will be asked for more data until 0 is returned
+  int len = copyPieces(buffer, chunkLimit(maxLen), cursor);
+  if (len > 0) {
+    metrics.tableChunk(len);
+    if (DEBUG) { Serial.printf("Adding %i bytes to buffer\n", len); }
+  } else {
+    if (DEBUG) { Serial.println("Complete buffer sent."); }
+  }
+  return len; // Return the actual length of the chunk (0 for end of file)
+}
+
+int getCSVChunk(char *buffer, int maxLen, TableCursor &cursor, GzipStream *gz) {
+  maxLen = chunkLimit(maxLen);
+  if (!gz) {
+    return copyPieces(buffer, maxLen, cursor);
+  }
+  int len = 0;
+  while (len < maxLen) {
+    len += gz->read((uint8_t *)buffer + len, maxLen - len);
+    if (len == maxLen) {
+      break;
+    }
+    if (cursor.pendingPos < cursor.pendingLen) {
+      cursor.pendingPos += gz->write((const uint8_t *)cursor.pending + cursor.pendingPos, cursor.pendingLen - cursor.pendingPos);
+    } else if (!nextTablePiece(cursor) && gz->finish() && gz->available() == 0) {
+      break; // all out, trailer included
+    }
+  }
+  return len;
+}
@@ -0,0 +1,96 @@
+/*
+
+Streaming JSON serialiser behind /table, and CSV behind /export.csv.
+Nothing is built up front: each response carries a TableCursor and rows are
+rendered straight out of the history store as the web server asks for
+chunks. A CSV export can be gzipped on the way out (gzip.h), still a chunk
+at a time. With points the samples are thinned for a chart (decimate.h) as
+they stream, so the response is at most that many rows however long the
+range.
+
+For DataTables' server-side processing the response is one page of the
+samples in RAM, in the order asked for, with the counts DataTables wants
+around it (beginPage()). Pages in time order are read straight off the
+ring, backwards for newest first. In order of a reading, each row is found
+with a pass over the ring, so there's still no list of rows to build or
+sort, but such a page is held to TABLE_PAGE_MAX rows.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <limits.h>
+#include "history.h"
+#include "flashlog.h"
+#include "gzip.h"
+#include "decimate.h"
+
+enum TableSource : uint8_t {
+  TABLE_RAW,     // one-minute samples in RAM: [time, co2, temp, humidity]
+  TABLE_QUARTER, // 15-minute buckets:  [time, co2 mean, temp, humidity, co2 min, co2 max]
+  TABLE_HOUR,    // hourly buckets, as above
+  TABLE_LOG,     // one-minute samples read from the flash log, as TABLE_RAW
+};
+
+enum TableFormat : uint8_t {
+  TABLE_JSON, // {"data":[[time,co2,temp,humidity],...]}
+  TABLE_CSV,  // a header line, then "2024-05-01 13:45:00,co2,temp,humidity" rows in local time
+};
+
+// Where a /table response is up to. Each response carries its own copy so
+// several dashboards can download at once without a shared JSON document.
+struct TableCursor {
+  union {
+    HistoryCursor row; // next sample/bucket to serialise
+    LogCursor log;     // ... or flash log record
+  };
+  union {
+    HistoryCursor row;
+    LogCursor log;
+  } ahead;            // with points: a bucket in front of the above, for Lttb::aim()
+  Lttb lttb;          // points() is 0 unless thinning
+  // a DataTables page (beginPage()), in order of sortColumn
+  bool paged;
+  bool descending;
+  uint8_t sortColumn; // 0 time, 1 co2, 2 temp, 3 humidity
+  uint32_t draw;      // echoed back, so DataTables can tell which request this answers
+  uint32_t total;     // samples in RAM when the response started
+  uint32_t pageLeft;  // rows still to send
+  uint64_t lastKey;   // sort key of the row sent last (sorted by a reading)
+  uint32_t endRow;    // pushed()/end() when the response started
+  time_t from, to;    // only rows in this time range
+  TableSource source;
+  TableFormat format;
+  uint8_t stage;      // 0 = header, 1 = rows, 2 = footer, 3 = done
+  bool wroteRow;      // whether the next row needs a leading comma
+  uint8_t pendingLen; // bytes of pending[] still to be copied out
+  uint8_t pendingPos;
+  char pending[80];   // the piece currently being written, e.g. one row or the page's counts
+};
+
+// Most rows in a page sorted by a reading (each costs a pass over the ring)
+#define TABLE_PAGE_MAX 100
+
+// Longest row, "[4294967295,65535,-327.68,655.35,65535,65535]" plus a comma and '\0'
+#define TABLE_ROW_MAX 48
+
+// Write one sample as a raw row, "[time,co2,temp,humidity]"; returns its
+// length (0 if size is under TABLE_ROW_MAX)
+int formatSample(char *out, size_t size, const Sample &s);
+
+// ETag for /table as it stands. Every response source changes only when a
+// sample is added, so one generation number (plus a per-boot id) covers them all.
+void tableETag(char *out, size_t size);
+
+// "raw", "15m" or "1h"; anything else is raw
+TableSource parseResolution(const char *res);
+// With points, samples (TABLE_RAW or TABLE_LOG) are thinned to at most that many
+TableCursor beginTable(TableSource source, time_t from = 0, time_t to = LONG_MAX, TableFormat format = TABLE_JSON, uint16_t points = 0);
+// DataTables server-side processing: rows start.. start+length-1 (all of them
+// from start for a negative length) of the samples in RAM sorted by column,
+// at most TABLE_PAGE_MAX of them unless in time order (column 0),
+// as {"data":[...],"draw":draw,"recordsTotal":n,"recordsFiltered":n}
+TableCursor beginPage(uint32_t draw, uint32_t start, int32_t length, uint8_t column, bool descending);
+int getJSONChunk(char *buffer, int maxLen, size_t index, TableCursor &cursor);
+// The same for a TABLE_CSV cursor, compressed through gz if it isn't null
+int getCSVChunk(char *buffer, int maxLen, TableCursor &cursor, GzipStream *gz);
@@ -0,0 +1,217 @@
+#define FS_NO_GLOBALS
+#include <FS.h>
+#include <limits.h>
+#include "uplink.h"
+#include "flashlog.h"
+#include "samplecodec.h"
+
+// settings.h for DEBUG
+#include "settings.h"
+
+#define UPLINK_HEAD_MAX 160 // room for the request line and headers, in front of the frame
+#define UPLINK_FRAME_MAX (UPLINK_HEADER_BYTES + UPLINK_BLOCK_BYTES)
+
+Uplink uplink;
+
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  p = put16(p, v);
+  return put16(p, v >> 16);
+}
+
+bool Uplink::begin(const char *url, uint32_t intervalMs) {
+  if (strncmp(url, "http://", 7) != 0) {
+    return false;
+  }
+  const char *host = url + 7;
+  const char *path = strchr(host, '/');
+  const char *colon = strchr(host, ':');
+  size_t hostLen = (colon && (!path || colon < path) ? colon : (path ? path : host + strlen(host))) - host;
+  if (hostLen == 0 || hostLen >= sizeof(_host) || (path && strlen(path) >= sizeof(_path))) {
+    return false;
+  }
+  memcpy(_host, host, hostLen);
+  _host[hostLen] = '\0';
+  _port = (colon && (!path || colon < path)) ? atoi(colon + 1) : 80;
+  strcpy(_path, path ? path : "/");
+  _interval = intervalMs;
+
+  _buf = new uint8_t[UPLINK_HEAD_MAX + UPLINK_FRAME_MAX];
+  fs::File f = SPIFFS.open(UPLINK_STATE_FILE, "r");
+  if (f && f.read((uint8_t *)&_next, sizeof(_next)) != sizeof(_next)) {
+    _next = 0;
+  }
+  if (_next > flashLog.end()) { // the log was wiped since
+    _next = 0;
+  }
+  _saved = _next;
+  _savedAt = millis();
+  _state = UPLINK_IDLE;
+  _since = millis() - intervalMs; // the first frame goes as soon as there is something to send
+  Serial.printf("Uplink to %s:%u%s, from log record %lu\n", _host, _port, _path, (unsigned long)_next);
+  return true;
+}
+
+uint32_t Uplink::backlog() const {
+  uint32_t first = flashLog.first();
+  return flashLog.end() - (_next > first ? _next : first);
+}
+
+void Uplink::save() {
+  if (_next == _saved) {
+    return;
+  }
+  fs::File f = SPIFFS.open(UPLINK_STATE_FILE, "w");
+  if (f && f.write((const uint8_t *)&_next, sizeof(_next)) == sizeof(_next)) {
+    _saved = _next;
+  }
+  _savedAt = millis();
+}
+
+// Fill the frame from log record _next on; returns the number of samples
+uint16_t Uplink::build() {
+  uint8_t *frame = _buf + UPLINK_HEAD_MAX;
+  SampleEncoder encoder;
+  encoder.begin(frame + UPLINK_HEADER_BYTES, UPLINK_BLOCK_BYTES);
+  LogCursor cursor = {};
+  cursor.n = _next;
+  cursor.to = LONG_MAX;
+  uint32_t before = cursor.n;
+  Sample s;
+  while (encoder.count() < UPLINK_BATCH && flashLog.read(cursor, s)) {
+    if (!encoder.add(s)) {
+      cursor.n = before; // the block is full, it starts the next frame
+      break;
+    }
+    before = cursor.n;
+  }
+  _sent = cursor.n;
+  _frameLen = UPLINK_HEADER_BYTES + encoder.bytes();
+
+  uint8_t *h = frame;
+  memcpy(h, "CO2F", 4);
+  h[4] = 2; // version
+  h[5] = 0;
+  h = put16(h + 6, encoder.bytes());
+  put32(h, ESP.getChipId());
+  return encoder.count();
+}
+
+void Uplink::send() {
+  _count = build();
+  if (_count == 0) {
+    _next = _sent; // nothing but unreadable records; step over them
+    _state = UPLINK_IDLE;
+    _since = millis();
+    return;
+  }
+  char head[UPLINK_HEAD_MAX];
+  int headLen = snprintf(head, sizeof(head),
+                         "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/octet-stream\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                         _path, _host, _frameLen);
+  if (headLen <= 0 || headLen >= (int)sizeof(head)) {
+    finish(false);
+    return;
+  }
+  // the head goes right in front of the frame, so the request is one buffer
+  _start = UPLINK_HEAD_MAX - headLen;
+  memcpy(_buf + _start, head, headLen);
+  _len = headLen + _frameLen;
+  _written = 0;
+  _done = false;
+  _status = 0;
+
+  _client = new AsyncClient();
+  _client->onConnect([](void *arg, AsyncClient *c) { ((Uplink *)arg)->writeMore(); }, this);
+  _client->onAck([](void *arg, AsyncClient *c, size_t len, uint32_t time) { ((Uplink *)arg)->writeMore(); }, this);
+  _client->onData([](void *arg, AsyncClient *c, void *data, size_t len) {
+    Uplink *self = (Uplink *)arg;
+    // all we want is the status code: "HTTP/1.1 204 ..."
+    if (self->_status == 0 && len >= 12 && memcmp(data, "HTTP/1.", 7) == 0) {
+      self->_status = atoi((const char *)data + 9);
+    }
+  }, this);
+  _client->onError([](void *arg, AsyncClient *c, int8_t error) { ((Uplink *)arg)->_done = true; }, this);
+  _client->onTimeout([](void *arg, AsyncClient *c, uint32_t time) { c->close(); }, this);
+  _client->onDisconnect([](void *arg, AsyncClient *c) { ((Uplink *)arg)->_done = true; }, this);
+  _client->setRxTimeout(UPLINK_TIMEOUT / 1000);
+  _state = UPLINK_SENDING;
+  _since = millis();
+  if (!_client->connect(_host, _port)) {
+    _done = true;
+  }
+}
+
+// As much of the request as lwIP has room for; the rest goes as it's acknowledged
+void Uplink::writeMore() {
+  if (!_client || _written >= _len) {
+    return;
+  }
+  size_t n = _client->space();
+  if (n > (size_t)(_len - _written)) {
+    n = _len - _written;
+  }
+  if (n > 0) {
+    _written += _client->add((const char *)_buf + _start + _written, n);
+    _client->send();
+  }
+}
+
+void Uplink::finish(bool ok) {
+  if (_client) {
+    delete _client;
+    _client = nullptr;
+  }
+  _since = millis();
+  if (ok) {
+    _next = _sent;
+    _frames++;
+    _samples += _count;
+    _backoff = UPLINK_BACKOFF_MIN;
+    _state = UPLINK_IDLE;
+    _draining = backlog() > 0;
+    if (DEBUG) { Serial.printf("Uplink: %u samples sent, %lu to go\n", _count, (unsigned long)backlog()); }
+  } else {
+    _failures++;
+    Serial.printf("Uplink: collector %s (%d), trying again in %lu s\n", _status ? "refused the frame" : "unreachable",
+                  _status, (unsigned long)(_backoff / 1000));
+    _state = UPLINK_BACKOFF;
+  }
+}
+
+void Uplink::update() {
+  switch (_state) {
+  case UPLINK_OFF:
+    break;
+
+  case UPLINK_IDLE:
+    // catching up after an outage, the frames go back to back
+    if (backlog() > 0 && (_draining || millis() - _since >= _interval)) {
+      send();
+    } else if (millis() - _savedAt >= UPLINK_SAVE_EVERY) {
+      save();
+    }
+    break;
+
+  case UPLINK_SENDING:
+    if (_done) {
+      finish(_status >= 200 && _status < 300);
+    } else if (millis() - _since >= UPLINK_TIMEOUT) {
+      _client->close(true); // its onDisconnect finishes it next time round
+      _done = true;
+    }
+    break;
+
+  case UPLINK_BACKOFF:
+    if (millis() - _since >= _backoff) {
+      _backoff = _backoff * 2 < UPLINK_BACKOFF_MAX ? _backoff * 2 : UPLINK_BACKOFF_MAX;
+      send();
+    }
+    break;
+  }
+}
@@ -0,0 +1,104 @@
+/*
+
+Store-and-forward uplink: pushes the logged samples to an HTTP collector in
+batches, so a fleet of badges can be charted in one place.
+
+The backlog is the flash log itself. Its record numbers never change, so
+all the uplink keeps is the number of the next record the collector hasn't
+acknowledged. Every UPLINK_INTERVAL it POSTs the records from there on, up
+to UPLINK_BATCH in one frame; after an outage the frames go back to back
+until it has caught up. The backlog is therefore bounded by the log (about
+7.5 days), and what the collector never got before its segment was deleted
+is skipped. The acknowledged position is saved to UPLINK_STATE_FILE at most
+every UPLINK_SAVE_EVERY, so a reboot resends at most that much; the
+collector drops what it already has.
+
+A POST that fails (no connection, no 2xx, or no answer within
+UPLINK_TIMEOUT) is tried again after UPLINK_BACKOFF_MIN, doubling each
+failure up to UPLINK_BACKOFF_MAX, as wifilink does for the access point.
+The request goes out through ESPAsyncTCP, so a slow or dead collector never
+holds up the display.
+
+A frame, little-endian (tools/collector.py decodes it):
+
+  "CO2F"  u8 version (2)  u8 reserved  u16 length of the block  u32 badge (chip id)
+  a block of samples, as samplecodec.h codes them
+
+A block holds UPLINK_BATCH samples in around 300 bytes, or fewer if they are
+noisy enough to fill UPLINK_BLOCK_BYTES first.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+#define UPLINK_BATCH 120 // samples per frame: 2 hours of them
+#define UPLINK_HEADER_BYTES 12
+#define UPLINK_BLOCK_BYTES 512
+#define UPLINK_TIMEOUT 15000 // ms
+#define UPLINK_BACKOFF_MIN 5000 // ms
+#define UPLINK_BACKOFF_MAX 300000 // ms
+#define UPLINK_SAVE_EVERY 600000 // ms
+#define UPLINK_STATE_FILE "/uplink.pos"
+
+enum UplinkState {
+  UPLINK_OFF,
+  UPLINK_IDLE,    // waiting for the next interval
+  UPLINK_SENDING,
+  UPLINK_BACKOFF, // waiting to try again
+};
+
+class Uplink {
+public:
+  // url as "http://host[:port]/path"; false (and the uplink stays off) if it isn't one
+  bool begin(const char *url, uint32_t intervalMs);
+  // From the network task, while Wi-Fi is up and the log has a clock
+  void update();
+  // Write the acknowledged position now, e.g. before a planned reboot
+  void save();
+
+  UplinkState state() const { return _state; }
+  bool enabled() const { return _state != UPLINK_OFF; }
+  uint32_t backlog() const; // logged samples the collector doesn't have yet
+  uint32_t frames() const { return _frames; } // acknowledged POSTs
+  uint32_t samples() const { return _samples; } // samples in them
+  uint32_t failures() const { return _failures; }
+
+private:
+  uint16_t build();
+  void send();
+  void finish(bool ok);
+  void writeMore();
+
+  char _host[40];
+  uint16_t _port = 80;
+  char _path[40];
+  uint32_t _interval = 0;
+
+  UplinkState _state = UPLINK_OFF;
+  uint32_t _since = 0; // millis() the current state began
+  uint32_t _backoff = UPLINK_BACKOFF_MIN;
+  uint32_t _next = 0;  // log record number the collector wants next
+  uint32_t _sent = 0;  // ...and after the frame in flight
+  bool _draining = false; // there was more to send after the last frame
+  uint32_t _saved = 0; // _next as on flash
+  uint32_t _savedAt = 0;
+
+  AsyncClient *_client = nullptr;
+  uint8_t *_buf = nullptr; // request head and frame, allocated by begin()
+  uint16_t _start = 0; // the request is _buf[_start.._start + _len)
+  uint16_t _len = 0;
+  uint16_t _written = 0;
+  uint16_t _count = 0;    // samples in the frame in flight
+  uint16_t _frameLen = 0; // ...and its length
+  // set by the AsyncClient callbacks, acted on in update()
+  volatile bool _done = false;
+  volatile int16_t _status = 0;
+
+  uint32_t _frames = 0;
+  uint32_t _samples = 0;
+  uint32_t _failures = 0;
+};
+
+extern Uplink uplink;
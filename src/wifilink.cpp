@@ -0,0 +1,61 @@
+#include "wifilink.h"
+#include <ESP8266WiFi.h>
+
+WiFiLink wifiLink;
+
+void WiFiLink::begin(const char *ssid, const char *password, void (*onFirstConnect)()) {
+  _ssid = ssid;
+  _password = password;
+  _onFirstConnect = onFirstConnect;
+  WiFi.persistent(false); // we call begin() on every retry, no need to rewrite the config to flash each time
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false); // retries are ours, with backoff
+  attempt();
+}
+
+void WiFiLink::attempt() {
+  Serial.printf("Connecting to Wi-Fi SSID: %s\n", _ssid);
+  WiFi.disconnect();
+  WiFi.begin(_ssid, _password);
+  _state = WIFI_LINK_CONNECTING;
+  _since = millis();
+}
+
+void WiFiLink::update() {
+  switch (_state) {
+  case WIFI_LINK_OFF:
+    break;
+
+  case WIFI_LINK_CONNECTING:
+    if (WiFi.status() == WL_CONNECTED) {
+      Serial.print("Connected, IP address: ");
+      Serial.println(WiFi.localIP());
+      _state = WIFI_LINK_UP;
+      _backoff = WIFI_BACKOFF_MIN;
+      if (_connects++ == 0 && _onFirstConnect) {
+        _onFirstConnect();
+      }
+    } else if (millis() - _since >= WIFI_CONNECT_TIMEOUT) {
+      _failures++;
+      Serial.printf("Unable to connect to Wi-Fi, trying again in %lu s\n", (unsigned long)(_backoff / 1000));
+      WiFi.disconnect();
+      _state = WIFI_LINK_BACKOFF;
+      _since = millis();
+    }
+    break;
+
+  case WIFI_LINK_BACKOFF:
+    if (millis() - _since >= _backoff) {
+      _backoff = _backoff * 2 < WIFI_BACKOFF_MAX ? _backoff * 2 : WIFI_BACKOFF_MAX;
+      attempt();
+    }
+    break;
+
+  case WIFI_LINK_UP:
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("Lost Wi-Fi, reconnecting");
+      attempt(); // straight away; the backoff only kicks in if that fails
+    }
+    break;
+  }
+}
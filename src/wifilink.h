@@ -0,0 +1,53 @@
+/*
+
+Wi-Fi in the background, so booting doesn't wait on the access point.
+
+begin() only starts the association; update() (the network task) watches
+it. An attempt that hasn't connected within WIFI_CONNECT_TIMEOUT is
+dropped, and the next waits WIFI_BACKOFF_MIN, doubling each failure up to
+WIFI_BACKOFF_MAX. A badge that boots during an AP outage (or loses the AP
+later) keeps retrying instead of switching Wi-Fi off for good.
+
+The onFirstConnect callback runs once, on the first successful association:
+that is where mDNS, NTP and the web server get started.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+
+#define WIFI_CONNECT_TIMEOUT 15000 // ms
+#define WIFI_BACKOFF_MIN 5000 // ms
+#define WIFI_BACKOFF_MAX 300000 // ms
+
+enum WiFiLinkState {
+  WIFI_LINK_OFF,
+  WIFI_LINK_CONNECTING,
+  WIFI_LINK_BACKOFF, // waiting to try again
+  WIFI_LINK_UP
+};
+
+class WiFiLink {
+public:
+  void begin(const char *ssid, const char *password, void (*onFirstConnect)());
+  void update();
+
+  WiFiLinkState state() const { return _state; }
+  bool up() const { return _state == WIFI_LINK_UP; }
+  uint32_t connects() const { return _connects; } // successful associations
+  uint32_t failures() const { return _failures; } // attempts that timed out
+
+private:
+  void attempt();
+
+  const char *_ssid;
+  const char *_password;
+  void (*_onFirstConnect)() = nullptr;
+  WiFiLinkState _state = WIFI_LINK_OFF;
+  uint32_t _since = 0;  // millis() the current state began
+  uint32_t _backoff = WIFI_BACKOFF_MIN;
+  uint32_t _connects = 0;
+  uint32_t _failures = 0;
+};
+
+extern WiFiLink wifiLink;
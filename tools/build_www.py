@@ -0,0 +1,140 @@
+"""
+Builds the web pages in web/ into data/www/ for the filesystem image.
+
+Every asset a page links to (css, js, images) is gzipped and renamed after a
+hash of its contents into data/www/a/, and the links in the page are
+rewritten to match. Those files never change under the same name, so the
+badge serves them with a year-long immutable Cache-Control and the browser
+doesn't ask again. The pages themselves keep their names (and no-cache), so
+a visit costs one small revalidated HTML fetch.
+
+Third-party libraries are committed in web/vendor/ so the dashboard works
+without internet access (e.g. on an isolated sensor VLAN), and the build
+doesn't need it either. The pinned versions in VENDOR are downloaded only
+when asked for, once, to be committed:
+    python tools/build_www.py --fetch-vendor
+
+Runs before every firmware build (extra_scripts in env:nodemcu), or by hand:
+    python tools/build_www.py
+"""
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import sys
+import urllib.request
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SRC = os.path.join(ROOT, "web")
+OUT = os.path.join(ROOT, "data", "www")
+ASSETS = "a"  # subdirectory (and URL prefix) of the hashed files
+
+VENDOR = {
+    "jquery.dataTables.min.js": "https://cdn.datatables.net/1.12.1/js/jquery.dataTables.min.js",
+    "jquery.dataTables.min.css": "https://cdn.datatables.net/1.12.1/css/jquery.dataTables.min.css",
+    "dataTables.buttons.min.js": "https://cdn.datatables.net/buttons/2.2.3/js/dataTables.buttons.min.js",
+    "buttons.dataTables.min.css": "https://cdn.datatables.net/buttons/2.2.3/css/buttons.dataTables.min.css",
+    "buttons.html5.min.js": "https://cdn.datatables.net/buttons/2.2.3/js/buttons.html5.min.js",
+}
+
+# SPIFFS names (including the path) are limited to 31 characters
+SPIFFS_NAME_MAX = 31
+
+LINK = re.compile(r'(\b(?:href|src)=")([^":/#?][^":]*)(")')
+
+
+def fetch_vendor():
+    for name, url in VENDOR.items():
+        path = os.path.join(SRC, "vendor", name)
+        if os.path.exists(path):
+            continue
+        print("build_www: fetching %s" % url)
+        try:
+            data = urllib.request.urlopen(url, timeout=30).read()
+        except OSError as e:
+            sys.exit("build_www: couldn't fetch %s (%s)" % (url, e))
+        with open(path, "wb") as f:
+            f.write(data)
+
+
+def check_vendor():
+    missing = [name for name in VENDOR if not os.path.exists(os.path.join(SRC, "vendor", name))]
+    if missing:
+        sys.exit("build_www: web/vendor/ is missing %s; run python tools/build_www.py --fetch-vendor "
+                 "once with internet access and commit them" % ", ".join(missing))
+
+
+def compress(data):
+    # mtime=0 so the same input always gives the same bytes (and no spurious image rebuilds)
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def write_if_changed(path, data):
+    if os.path.exists(path):
+        with open(path, "rb") as f:
+            if f.read() == data:
+                return
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def hashed_name(rel, data):
+    stem, ext = os.path.splitext(os.path.basename(rel))
+    stem = re.sub(r"[^A-Za-z]", "", stem.split(".")[0])[:8]
+    name = "%s.%s%s" % (stem, hashlib.sha1(data).hexdigest()[:8], ext)
+    if len("/www/%s/%s.gz" % (ASSETS, name)) > SPIFFS_NAME_MAX:
+        sys.exit("build_www: %s is too long a name for SPIFFS" % name)
+    return name
+
+
+def build():
+    check_vendor()
+    os.makedirs(os.path.join(OUT, ASSETS), exist_ok=True)
+    built = {}  # source path -> (hashed name, file name)
+
+    def asset(match):
+        rel = match.group(2)
+        src = os.path.normpath(os.path.join(SRC, rel))
+        if not os.path.isfile(src):
+            sys.exit("build_www: %s links to missing %s" % (page, rel))
+        if src not in built:
+            with open(src, "rb") as f:
+                data = f.read()
+            name = hashed_name(rel, data)
+            packed = compress(data)
+            if len(packed) < len(data):  # not so for images
+                write_if_changed(os.path.join(OUT, ASSETS, name + ".gz"), packed)
+                built[src] = (name, name + ".gz")
+            else:
+                write_if_changed(os.path.join(OUT, ASSETS, name), data)
+                built[src] = (name, name)
+        return match.group(1) + ASSETS + "/" + built[src][0] + match.group(3)
+
+    pages = []
+    for page in sorted(os.listdir(SRC)):
+        if not page.endswith(".html"):
+            continue
+        with open(os.path.join(SRC, page), encoding="utf-8") as f:
+            html = LINK.sub(asset, f.read())
+        write_if_changed(os.path.join(OUT, page + ".gz"), compress(html.encode("utf-8")))
+        pages.append(page + ".gz")
+
+    # drop anything from earlier builds, SPIFFS space is tight
+    keep = set(file for name, file in built.values())
+    for name in os.listdir(os.path.join(OUT, ASSETS)):
+        if name not in keep:
+            os.remove(os.path.join(OUT, ASSETS, name))
+    for name in os.listdir(OUT):
+        path = os.path.join(OUT, name)
+        if name != ASSETS and name not in pages:
+            shutil.rmtree(path) if os.path.isdir(path) else os.remove(path)
+
+
+if __name__ == "__main__":
+    if "--fetch-vendor" in sys.argv[1:]:
+        fetch_vendor()
+    build()
+else:
+    Import("env")  # noqa: F821 (PlatformIO provides it)
+    build()
@@ -0,0 +1,210 @@
+/*
+
+Host benchmark of the sample codec (src/samplecodec.h): how many bytes a
+sample takes, against the raw records, and how fast it codes them. It checks
+every block decodes back to what went in, and that a sample which doesn't
+fit leaves the block as it was for the next one.
+
+  g++ -O2 -Isim -Isrc tools/codec_bench.cpp src/samplecodec.cpp -o codec_bench && ./codec_bench [trace.bin]...
+
+Traces are sensor recordings (tools/trace.py). Each is measured twice: as
+the history sees it, the reading at the end of each minute, and every
+reading as the sensor gave it. With no trace it makes up a day of readings.
+
+*/
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "samplecodec.h"
+
+static const int BLOCK_SIZES[] = { 128, 512, 2048 };
+static const int ROUNDS = 20;
+static volatile uint32_t sink; // keeps the optimiser honest
+
+// Readings from an SCT1 trace, times in seconds from 2025-10-09
+static bool loadTrace(const char *path, std::vector<Sample> &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+  fclose(f);
+  if (data.size() < 4 || memcmp(data.data(), "SCT1", 4) != 0) {
+    return false;
+  }
+  uint32_t tenths = 0;
+  Sample s = { 0, 0, 0, 0 };
+  for (size_t pos = 4; pos < data.size();) {
+    const uint8_t *p = &data[pos];
+    if (p[0] == 0xFF) {
+      if (pos + 11 > data.size()) break;
+      tenths += p[1] | p[2] << 8 | p[3] << 16 | (uint32_t)p[4] << 24;
+      s.co2 = p[5] | p[6] << 8;
+      s.temp = (int16_t)(p[7] | p[8] << 8);
+      s.humidity = p[9] | p[10] << 8;
+      pos += 11;
+    } else {
+      if (pos + 4 > data.size()) break;
+      tenths += p[0];
+      s.co2 += (int8_t)p[1];
+      s.temp += (int8_t)p[2];
+      s.humidity += (int8_t)p[3];
+      pos += 4;
+    }
+    s.time = 1760000000u + tenths / 10;
+    out.push_back(s);
+  }
+  return true;
+}
+
+static std::vector<Sample> perMinute(const std::vector<Sample> &readings) {
+  std::vector<Sample> out;
+  for (size_t i = 0; i < readings.size(); i++) {
+    if (i + 1 == readings.size() || readings[i + 1].time / 60 != readings[i].time / 60) {
+      Sample s = readings[i];
+      s.time = s.time / 60 * 60 + 60;
+      out.push_back(s);
+    }
+  }
+  return out;
+}
+
+static std::vector<Sample> madeUp() {
+  std::vector<Sample> out;
+  uint32_t seed = 12345;
+  int co2 = 450, temp = 2100, humidity = 4500;
+  for (int i = 0; i < 24 * 60; i++) {
+    seed = seed * 1103515245 + 12345;
+    co2 += (int)(seed >> 16) % 21 - 10 + (i % 480 < 240 ? 2 : -2);
+    temp += (int)(seed >> 8) % 5 - 2;
+    humidity += (int)(seed >> 4) % 31 - 15;
+    out.push_back({ (time_t)(1760000000u + i * 60), (uint16_t)constrain(co2, 400, 5000), (int16_t)temp, (uint16_t)constrain(humidity, 0, 10000) });
+  }
+  return out;
+}
+
+template <typename F>
+static double nsPer(size_t count, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    body();
+  }
+  auto took = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(took).count() / ((double)ROUNDS * count);
+}
+
+static bool same(const Sample &a, const Sample &b) {
+  return (uint32_t)a.time == (uint32_t)b.time && a.co2 == b.co2 && a.temp == b.temp && a.humidity == b.humidity;
+}
+
+static void measure(const char *name, const std::vector<Sample> &samples) {
+  printf("%s: %zu samples\n", name, samples.size());
+  printf("  %-6s %8s %8s %10s %10s %10s %10s\n", "block", "blocks", "B/sample", "vs ring 8", "vs log 12", "enc ns", "dec ns");
+  for (int size : BLOCK_SIZES) {
+    std::vector<uint8_t> blocks; // each one a u16 length, then the block
+    auto encode = [&] {
+      blocks.clear();
+      std::vector<uint8_t> block(size);
+      SampleEncoder encoder;
+      encoder.begin(block.data(), size);
+      auto flush = [&] {
+        uint16_t len = encoder.bytes();
+        blocks.push_back(len);
+        blocks.push_back(len >> 8);
+        blocks.insert(blocks.end(), block.begin(), block.begin() + len);
+      };
+      for (const Sample &s : samples) {
+        if (!encoder.add(s)) {
+          flush();
+          encoder.begin(block.data(), size);
+          encoder.add(s);
+        }
+      }
+      if (encoder.count()) flush();
+    };
+    size_t decoded = 0, mismatches = 0, count = 0;
+    auto decode = [&] {
+      decoded = mismatches = count = 0;
+      SampleDecoder decoder;
+      Sample s;
+      for (size_t pos = 0; pos < blocks.size();) {
+        uint16_t len = blocks[pos] | blocks[pos + 1] << 8;
+        decoder.begin(&blocks[pos + 2], len);
+        while (decoder.next(s)) {
+          if (!same(s, samples[decoded])) mismatches++;
+          decoded++;
+          sink += s.co2;
+        }
+        count++;
+        pos += 2 + len;
+      }
+    };
+    double encodeNs = nsPer(samples.size(), encode);
+    double decodeNs = nsPer(samples.size(), decode);
+    size_t bytes = blocks.size() - 2 * count; // without the lengths, which the bench added
+    double perSample = (double)bytes / samples.size();
+    printf("  %-6d %8zu %8.2f %9.1fx %9.1fx %10.1f %10.1f%s\n", size, count, perSample, 8 / perSample, 12 / perSample,
+      encodeNs, decodeNs, decoded != samples.size() || mismatches ? "  MISMATCH" : "");
+  }
+}
+
+// A sample that doesn't fit, then one that does: for every block size that
+// splits the first one partway through a byte, the block holds exactly what was added
+static bool checkRollback() {
+  const Sample small = { 1760000060, 455, 2101, 4498 };
+  const Sample big = { 1760090000, 4000, -500, 9000 };
+  bool ok = true;
+  for (int size = CODEC_HEADER_BYTES; size <= 64; size++) {
+    for (int before = 0; before < 4; before++) {
+      std::vector<uint8_t> block(size);
+      std::vector<Sample> added;
+      SampleEncoder encoder;
+      encoder.begin(block.data(), size);
+      Sample s = { 1760000000, 450, 2100, 4500 };
+      for (int i = 0; i <= before; i++, s.time += 60, s.co2 += 3) {
+        if (encoder.add(s)) added.push_back(s);
+      }
+      Sample tries[] = { big, small };
+      tries[1].time = s.time;
+      for (Sample t : tries) {
+        if (encoder.add(t)) added.push_back(t);
+      }
+      SampleDecoder decoder;
+      decoder.begin(block.data(), encoder.bytes());
+      size_t n = 0;
+      while (decoder.next(s)) {
+        if (n >= added.size() || !same(s, added[n])) break;
+        n++;
+      }
+      if (n != added.size() || decoder.count() != added.size()) {
+        printf("rollback: block of %d, %d before: MISMATCH\n", size, before + 1);
+        ok = false;
+      }
+    }
+  }
+  printf("rollback: %s\n", ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (!checkRollback()) {
+    return 1;
+  }
+  if (argc < 2) {
+    measure("made up, per minute", madeUp());
+  }
+  for (int i = 1; i < argc; i++) {
+    std::vector<Sample> readings;
+    if (!loadTrace(argv[i], readings)) {
+      printf("%s: not a trace file\n", argv[i]);
+      return 1;
+    }
+    std::string name = argv[i];
+    measure((name + ", per minute").c_str(), perMinute(readings));
+    measure((name + ", every reading").c_str(), readings);
+  }
+  return 0;
+}
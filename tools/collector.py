@@ -0,0 +1,188 @@
+"""
+A stand-in collector for the uplink (src/uplink.h): takes the badges' frames
+over HTTP and appends their samples to one CSV per badge.
+
+    python tools/collector.py [--port 8080] [--dir collected]
+
+and on the badges, in settings.h:
+
+    #define UPLINK_URL "http://<this machine>:8080/ingest"
+
+Each CSV (collected/<chip id>.csv) has a header and one sample per row: unix
+time, CO2 ppm, temperature in degrees C and relative humidity in %. Frames from
+firmware before the sample codec (version 1) are still taken. A badge
+resends what it sent in the last few minutes after a reboot, so samples
+already in the file are dropped.
+"""
+import argparse
+import csv
+import os
+import struct
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from threading import Lock
+
+MAGIC = b"CO2F"
+HEADER_V1 = struct.Struct("<4sBxHII")
+SAMPLE_V1 = struct.Struct("<HHhH")
+HEADER = struct.Struct("<4sBxHI")
+BLOCK_HEADER = struct.Struct("<HIHhH")
+COLUMNS = ["time", "co2", "temp", "humidity"]
+
+# src/samplecodec.cpp
+RICE_LIMIT = 24
+RICE_WINDOW = 16
+RICE_START_SUM = 8
+
+
+class Bits:
+    def __init__(self, data):
+        self.value = int.from_bytes(data, "little")
+        self.left = len(data) * 8
+
+    def get(self, count):
+        if count > self.left:
+            raise ValueError("block cut short")
+        v = self.value & ((1 << count) - 1)
+        self.value >>= count
+        self.left -= count
+        return v
+
+
+class Rice:
+    def __init__(self):
+        self.sum, self.count = RICE_START_SUM, 1
+
+    def get(self, bits, raw_bits):
+        k = 0
+        while (self.count << k) < self.sum and k < 31:
+            k += 1
+        q = 0
+        while bits.get(1):
+            q += 1
+            if q == RICE_LIMIT:
+                value = bits.get(raw_bits)
+                break
+        else:
+            value = q << k | bits.get(k)
+        self.sum += min(value, 0xFFFF)
+        self.count += 1
+        if self.count == RICE_WINDOW:
+            self.sum >>= 1
+            self.count >>= 1
+        return value
+
+
+def unzigzag(v, bits):
+    v = (v >> 1) ^ -(v & 1)
+    return v & ((1 << bits) - 1)
+
+
+def signed16(v):
+    return (v + 0x8000) % 0x10000 - 0x8000
+
+
+def decode_block(block):
+    """[(unix time, co2, centi temp, centi humidity)] from a samplecodec.h block."""
+    count, time, co2, temp, humidity = BLOCK_HEADER.unpack_from(block)
+    samples = [(time, co2, temp, humidity)] if count else []
+    bits = Bits(block[BLOCK_HEADER.size:])
+    rice = [Rice() for _ in range(4)]
+    interval = 0
+    for _ in range(count - 1):
+        interval = (interval + unzigzag(rice[0].get(bits, 32), 32)) & 0xFFFFFFFF
+        time = (time + interval) & 0xFFFFFFFF
+        co2 = (co2 + unzigzag(rice[1].get(bits, 16), 16)) & 0xFFFF
+        temp = signed16(temp + unzigzag(rice[2].get(bits, 16), 16))
+        humidity = (humidity + unzigzag(rice[3].get(bits, 16), 16)) & 0xFFFF
+        samples.append((time, co2, temp, humidity))
+    return samples
+
+
+def decode_v1(frame):
+    magic, version, count, badge, time = HEADER_V1.unpack_from(frame)
+    if len(frame) != HEADER_V1.size + count * SAMPLE_V1.size:
+        return None
+    samples = []
+    for i in range(count):
+        dt, co2, temp, humidity = SAMPLE_V1.unpack_from(frame, HEADER_V1.size + i * SAMPLE_V1.size)
+        time += dt
+        samples.append((time, co2, temp, humidity))
+    return badge, samples
+
+
+def decode(frame):
+    """(badge, [(unix time, co2, centi temp, centi humidity)]), or None if it isn't a frame."""
+    if len(frame) < HEADER.size or frame[:4] != MAGIC:
+        return None
+    if frame[4] == 1:  # from firmware before the sample codec
+        return decode_v1(frame) if len(frame) >= HEADER_V1.size else None
+    magic, version, length, badge = HEADER.unpack_from(frame)
+    if version != 2 or length < BLOCK_HEADER.size or len(frame) != HEADER.size + length:
+        return None
+    try:
+        return badge, decode_block(frame[HEADER.size:])
+    except ValueError:
+        return None
+
+
+class Store:
+    def __init__(self, directory):
+        self.directory = directory
+        self.seen = {}  # badge -> set of sample times in its file
+        self.lock = Lock()
+        os.makedirs(directory, exist_ok=True)
+
+    def path(self, badge):
+        return os.path.join(self.directory, "%08x.csv" % badge)
+
+    def times(self, badge):
+        if badge not in self.seen:
+            seen = set()
+            if os.path.exists(self.path(badge)):
+                with open(self.path(badge), newline="") as f:
+                    seen = {int(row["time"]) for row in csv.DictReader(f)}
+            self.seen[badge] = seen
+        return self.seen[badge]
+
+    def add(self, badge, samples):
+        """Appends the samples it doesn't have yet; returns how many that was."""
+        with self.lock:
+            seen = self.times(badge)
+            new = [s for s in samples if s[0] not in seen]
+            header = not os.path.exists(self.path(badge))
+            with open(self.path(badge), "a", newline="") as f:
+                out = csv.writer(f, lineterminator="\n")
+                if header:
+                    out.writerow(COLUMNS)
+                for time, co2, temp, humidity in new:
+                    out.writerow([time, co2, "%.2f" % (temp / 100), "%.2f" % (humidity / 100)])
+            seen.update(s[0] for s in new)
+            return len(new)
+
+
+def handler(store):
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            frame = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            decoded = decode(frame)
+            if decoded is None:
+                self.send_response(400)
+                self.end_headers()
+                return
+            badge, samples = decoded
+            new = store.add(badge, samples)
+            self.log_message("badge %08x: %d samples, %d new", badge, len(samples), new)
+            self.send_response(204)
+            self.end_headers()
+
+    return Handler
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--dir", default="collected")
+    args = parser.parse_args()
+    server = ThreadingHTTPServer(("", args.port), handler(Store(args.dir)))
+    print("collecting on port %d into %s/" % (args.port, args.dir))
+    server.serve_forever()
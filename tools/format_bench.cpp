@@ -0,0 +1,121 @@
+/*
+
+Host benchmark of the fixed-point formatters (src/format.h) against the
+printf/float code they replaced, on the three hot paths: a /table row, the
+display's temperature & humidity strings, and /temp. It also checks both
+give the same text.
+
+  g++ -O2 -Isim -Isrc tools/format_bench.cpp src/format.cpp -o format_bench && ./format_bench
+
+The host has an FPU, so the float numbers here flatter the old code; on the
+ESP8266 every float operation is a soft-float library call.
+
+*/
+#include <Arduino.h>
+#include <chrono>
+#include "format.h"
+
+struct Reading {
+  uint32_t time;
+  uint16_t co2;
+  int16_t temp;      // centi
+  uint16_t humidity; // centi
+};
+
+static const int READINGS = 1440;
+static const int ROUNDS = 200;
+static Reading readings[READINGS];
+static volatile size_t sink; // keeps the optimiser honest
+
+// --- before ---
+
+static int rowPrintf(char *out, size_t size, const Reading &r) {
+  return snprintf(out, size, "[%lu,%u,%s%d.%02d,%u.%02u]",
+    (unsigned long)r.time, r.co2,
+    r.temp < 0 ? "-" : "", abs(r.temp) / 100, abs(r.temp) % 100,
+    r.humidity / 100, r.humidity % 100);
+}
+
+static int displayFloat(char *temp, char *humidity, float t, float h) {
+  snprintf(temp, 16, "%.1f °C", t);
+  return snprintf(humidity, 16, "%.0f", h);
+}
+
+// --- after ---
+
+static int rowFixed(char *out, const Reading &r) {
+  char *p = out;
+  *p++ = '[';
+  p = appendUnsigned(p, r.time);
+  *p++ = ',';
+  p = appendUnsigned(p, r.co2);
+  *p++ = ',';
+  p = appendCenti(p, r.temp, 2);
+  *p++ = ',';
+  p = appendCenti(p, r.humidity, 2);
+  *p++ = ']';
+  *p = '\0';
+  return p - out;
+}
+
+static int displayFixed(char *temp, char *humidity, int16_t t, uint16_t h) {
+  strcpy(appendCenti(temp, t, 1), " °C");
+  char *end = appendCenti(humidity, h, 0);
+  *end = '\0';
+  return end - humidity;
+}
+
+template <typename F>
+static double nsPer(int count, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    body();
+  }
+  auto took = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(took).count() / ((double)ROUNDS * count);
+}
+
+int main() {
+  uint32_t seed = 12345;
+  size_t rowBytes = 0;
+  for (int i = 0; i < READINGS; i++) {
+    seed = seed * 1103515245 + 12345;
+    readings[i] = { 1760000000u + i * 60, (uint16_t)(400 + seed % 2000), (int16_t)((int)(seed >> 8) % 4000 - 500), (uint16_t)((seed >> 4) % 10000) };
+  }
+
+  // same text both ways (the float path is fed hundredths, so the rounding matches)
+  int mismatches = 0;
+  for (int i = 0; i < READINGS; i++) {
+    char a[48], b[48], c[16], d[16], e[16], f[16];
+    rowPrintf(a, sizeof(a), readings[i]);
+    rowFixed(b, readings[i]);
+    rowBytes += strlen(b) + 1;
+    displayFloat(c, d, readings[i].temp / 100.0f, readings[i].humidity / 100.0f);
+    displayFixed(e, f, readings[i].temp, readings[i].humidity);
+    // except that printf rounds exact halves to even (18.5 -> "18") where appendCenti() rounds
+    // away from zero, and printf can give "-0.0"
+    int16_t t = readings[i].temp;
+    if (strcmp(a, b) != 0) mismatches++;
+    if (strcmp(c, e) != 0 && abs(t) % 10 != 5 && !(t < 0 && t > -5)) mismatches++;
+    if (strcmp(d, f) != 0 && readings[i].humidity % 100 != 50) mismatches++;
+  }
+
+  char buffer[48], temp[16], humidity[16];
+  double rowBefore = nsPer(READINGS, [&] { for (int i = 0; i < READINGS; i++) sink += rowPrintf(buffer, sizeof(buffer), readings[i]); });
+  double rowAfter = nsPer(READINGS, [&] { for (int i = 0; i < READINGS; i++) sink += rowFixed(buffer, readings[i]); });
+  double displayBefore = nsPer(READINGS, [&] {
+    for (int i = 0; i < READINGS; i++) sink += displayFloat(temp, humidity, readings[i].temp / 100.0f, readings[i].humidity / 100.0f);
+  });
+  double displayAfter = nsPer(READINGS, [&] { for (int i = 0; i < READINGS; i++) sink += displayFixed(temp, humidity, readings[i].temp, readings[i].humidity); });
+  double tempBefore = nsPer(READINGS, [&] { for (int i = 0; i < READINGS; i++) sink += snprintf(temp, sizeof(temp), "%.2f", readings[i].temp / 100.0f); });
+  double tempAfter = nsPer(READINGS, [&] { for (int i = 0; i < READINGS; i++) sink += appendCenti(temp, readings[i].temp, 2) - temp; });
+
+  double rowsPerChunk = 1460.0 / ((double)rowBytes / READINGS); // one TCP segment's worth of /table
+  printf("%-24s %10s %10s %8s\n", "", "before ns", "after ns", "speedup");
+  printf("%-24s %10.1f %10.1f %7.1fx\n", "/table row", rowBefore, rowAfter, rowBefore / rowAfter);
+  printf("%-24s %10.1f %10.1f %7.1fx\n", "/table 1460 B chunk", rowBefore * rowsPerChunk, rowAfter * rowsPerChunk, rowBefore / rowAfter);
+  printf("%-24s %10.1f %10.1f %7.1fx\n", "display temp+humidity", displayBefore, displayAfter, displayBefore / displayAfter);
+  printf("%-24s %10.1f %10.1f %7.1fx\n", "/temp", tempBefore, tempAfter, tempBefore / tempAfter);
+  printf("%d mismatches\n", mismatches);
+  return mismatches != 0;
+}
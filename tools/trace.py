@@ -0,0 +1,91 @@
+"""
+Converts sensor traces (lib/SCD30_Fake/SCD30_Trace.h) to CSV and back.
+
+    python tools/trace.py dump trace.bin > trace.csv
+    python tools/trace.py encode trace.csv trace.bin
+
+The CSV has a header and one reading per row: seconds since the start of
+the trace, CO2 ppm, temperature in degrees C and relative humidity in %.
+Edit a recorded trace, stitch several together or write one from some other
+source, then replay it on the badge (TRACE_REPLAY) or the simulator
+(--trace).
+"""
+import csv
+import struct
+import sys
+
+MAGIC = b"SCT1"
+KEY = 0xFF
+COLUMNS = ["seconds", "co2", "temp", "humidity"]
+
+
+def decode(data):
+    """Yields (tenths of a second since the start, co2, centi temp, centi humidity)."""
+    if data[:4] != MAGIC:
+        sys.exit("not a trace file")
+    pos = 4
+    time = co2 = temp = humidity = 0
+    while pos < len(data):
+        if data[pos] == KEY:
+            if pos + 11 > len(data):
+                break  # torn by a power cut mid-write
+            dt, co2, temp, humidity = struct.unpack_from("<IHhH", data, pos + 1)
+            pos += 11
+        else:
+            if pos + 4 > len(data):
+                break
+            dt, d_co2, d_temp, d_humidity = struct.unpack_from("<Bbbb", data, pos)
+            co2 = (co2 + d_co2) & 0xFFFF
+            temp = (temp + d_temp + 0x8000) % 0x10000 - 0x8000
+            humidity = (humidity + d_humidity) & 0xFFFF
+            pos += 4
+        time += dt
+        yield time, co2, temp, humidity
+
+
+def encode(readings):
+    """Readings as (tenths, co2, centi temp, centi humidity); the same choices as TraceWriter."""
+    out = bytearray(MAGIC)
+    last = None
+    for time, co2, temp, humidity in readings:
+        if last is None:
+            dt, deltas = 0, None
+        else:
+            dt = time - last[0]
+            deltas = (co2 - last[1], temp - last[2], humidity - last[3])
+        if dt < 0:
+            sys.exit("readings must be in time order")
+        if deltas is None or dt >= KEY or any(d < -128 or d > 127 for d in deltas):
+            out += struct.pack("<BIHhH", KEY, dt, co2, temp, humidity)
+        else:
+            out += struct.pack("<Bbbb", dt, *deltas)
+        last = (time, co2, temp, humidity)
+    return bytes(out)
+
+
+def dump(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    out = csv.writer(sys.stdout, lineterminator="\n")
+    out.writerow(COLUMNS)
+    for time, co2, temp, humidity in decode(data):
+        out.writerow(["%.1f" % (time / 10), co2, "%.2f" % (temp / 100), "%.2f" % (humidity / 100)])
+
+
+def read_csv(path):
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            yield (round(float(row["seconds"]) * 10), int(row["co2"]),
+                   round(float(row["temp"]) * 100), round(float(row["humidity"]) * 100))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 and sys.argv[1] == "dump":
+        dump(sys.argv[2])
+    elif len(sys.argv) == 4 and sys.argv[1] == "encode":
+        data = encode(read_csv(sys.argv[2]))
+        with open(sys.argv[3], "wb") as f:
+            f.write(data)
+        print("%d bytes" % len(data))
+    else:
+        sys.exit(__doc__)
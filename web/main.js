@@ -73,23 +73,35 @@ document.getElementById("gauge3"), {
 }
 );
 
-// run once to get initial values
-getCO2Data();
-getTemperatureData();
-getHumidityData();
-
-// Thanks: https://github.com/melkati/CO2-Gadget
-setInterval(function () {
+// Live readings are pushed over /events as "[time,co2,temp,humidity]"; the
+// badge sends the current one as soon as we connect and the browser reconnects by itself
+if (window.EventSource) {
+  var source = new EventSource("/events");
+  source.addEventListener("reading", function (e) {
+	var reading = JSON.parse(e.data);
+	gauge1.setValueAnimated(reading[1], 2);
+	gauge2.setValueAnimated(reading[2], 2);
+	gauge3.setValueAnimated(reading[3], 2);
+  });
+} else { // no EventSource (old browsers): poll like we used to
+  // run once to get initial values
   getCO2Data();
-}, 5000); // 5s update rate
-
-setInterval(function () {
   getTemperatureData();
-}, 30000); // 30s update rate
-
-setInterval(function () {
   getHumidityData();
-}, 30000); // 30s update rate
+
+  // Thanks: https://github.com/melkati/CO2-Gadget
+  setInterval(function () {
+	getCO2Data();
+  }, 5000); // 5s update rate
+
+  setInterval(function () {
+	getTemperatureData();
+  }, 30000); // 30s update rate
+
+  setInterval(function () {
+	getHumidityData();
+  }, 30000); // 30s update rate
+}
 
 function getCO2Data() {
   var xhttp = new XMLHttpRequest();
@@ -132,19 +144,24 @@ function getHumidityData() {
 
 // datatables
 $(document).ready(function () {
+  // paged, sorted and counted on the badge (server-side processing), so each
+  // load is the 10 rows on show rather than the whole 24 hours
   var indexTable = $('#co2table').DataTable({
-	"ajax": {
-	  "url": "/table",
-	  "dataSrc": "data"
-	},
+	serverSide: true,
+	ajax: "/table",
+	order: [[0, "desc"]],
+	searching: false,
 	stateSave: true,
-	dom: 'Bfrtip',
+	dom: 'Brtip',
 	buttons: [
-	  'copy', 'csv'
+	  // (no Copy/CSV of the table itself: it only holds the page on show)
+	  // everything in the badge's flash log, made on the badge (and gzipped on the way)
+	  { text: 'CSV (week)', action: function () { window.location = '/export.csv'; } }
 	]
   });
 
+  // the same page again, with whatever's new
   setInterval( function () {
-	indexTable.ajax.reload();
+	indexTable.ajax.reload(null, false);
   }, 60000); // 60s update rate
 });